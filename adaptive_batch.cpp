@@ -0,0 +1,64 @@
+#include "adaptive_batch.h"
+
+namespace rest_client {
+
+/** ------ adaptive batch controller defination ------ */
+// weight of the newest request in the moving averages
+static const double BATCH_EWMA_WEIGHT = 0.2;
+
+AdaptiveBatchController::AdaptiveBatchController(
+    const AdaptiveBatchOptions& options)
+    : options_(options) {
+    if (options_.minRows == 0) options_.minRows = 1;
+    if (options_.maxRows < options_.minRows) {
+        options_.maxRows = options_.minRows;
+    }
+    targetRows_ = options_.initialRows;
+    if (targetRows_ < options_.minRows) targetRows_ = options_.minRows;
+    if (targetRows_ > options_.maxRows) targetRows_ = options_.maxRows;
+    stats_.targetRows = targetRows_;
+    stats_.requests = 0;
+    stats_.decreases = 0;
+    stats_.latencyMicros = 0;
+    stats_.rowsPerSecond = 0;
+}
+
+void AdaptiveBatchController::onRequest(size_t rows, uint64_t latencyMicros,
+                                        bool ok) {
+    MutexLock lock(mutex_);
+    double rowsPerSecond =
+        latencyMicros == 0 ? 0 : rows * 1000000.0 / latencyMicros;
+    if (stats_.requests == 0) {
+        stats_.latencyMicros = latencyMicros;
+        stats_.rowsPerSecond = rowsPerSecond;
+    } else {
+        stats_.latencyMicros += BATCH_EWMA_WEIGHT *
+                                ((double)latencyMicros - stats_.latencyMicros);
+        stats_.rowsPerSecond +=
+            BATCH_EWMA_WEIGHT * (rowsPerSecond - stats_.rowsPerSecond);
+    }
+    stats_.requests++;
+
+    size_t target = targetRows_;
+    if (!ok || latencyMicros > options_.targetLatencyMs * 1000) {
+        target = (size_t)(target * options_.decreaseFactor);
+        stats_.decreases++;
+    } else if (rows + options_.increaseRows >= target) {
+        // only grow when the batch actually used most of the setpoint,
+        // partially filled tablets say nothing about larger ones
+        target += options_.increaseRows;
+    }
+    if (target < options_.minRows) target = options_.minRows;
+    if (target > options_.maxRows) target = options_.maxRows;
+    stats_.targetRows = target;
+    __atomic_store_n(&targetRows_, target, __ATOMIC_RELAXED);
+}
+
+AdaptiveBatchController::Stats AdaptiveBatchController::getStats() {
+    MutexLock lock(mutex_);
+    return stats_;
+}
+
+/** ------ end adaptive batch controller defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,67 @@
+#ifndef ADAPTIVE_BATCH_H
+#define ADAPTIVE_BATCH_H
+
+#include "concurrency.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ adaptive batch controller ------ */
+struct AdaptiveBatchOptions {
+    size_t minRows;
+    size_t maxRows;
+    size_t initialRows;
+    uint64_t targetLatencyMs;  // requests slower than this shrink batches
+    size_t increaseRows;       // additive increase after a fast request
+    double decreaseFactor;     // multiplicative decrease after a slow one
+
+    AdaptiveBatchOptions()
+        : minRows(64),
+          maxRows(65536),
+          initialRows(1024),
+          targetLatencyMs(200),
+          increaseRows(256),
+          decreaseFactor(0.5) {}
+};
+
+/**
+ * AIMD controller for the number of rows a writer puts into one insertTablet
+ * request. Every finished request reports its size and latency: a request
+ * that succeeded within targetLatencyMs grows the setpoint by increaseRows,
+ * a slow or failed one scales it by decreaseFactor, always within
+ * [minRows, maxRows]. Shared by all sender threads of a writer.
+ */
+class AdaptiveBatchController {
+   public:
+    struct Stats {
+        size_t targetRows;  // current setpoint
+        uint64_t requests;
+        uint64_t decreases;
+        double latencyMicros;  // moving average
+        double rowsPerSecond;  // moving average of per request throughput
+    };
+
+    explicit AdaptiveBatchController(const AdaptiveBatchOptions &options);
+
+    size_t targetRows() const {
+        return __atomic_load_n(&targetRows_, __ATOMIC_RELAXED);
+    }
+
+    void onRequest(size_t rows, uint64_t latencyMicros, bool ok);
+
+    Stats getStats();
+
+   private:
+    AdaptiveBatchController(const AdaptiveBatchController &);
+    AdaptiveBatchController &operator=(const AdaptiveBatchController &);
+
+    AdaptiveBatchOptions options_;
+    size_t targetRows_;
+    Mutex mutex_;
+    Stats stats_;
+};
+
+/** ------ end adaptive batch controller ------ */
+
+}  // namespace rest_client
+#endif  // ADAPTIVE_BATCH_H
@@ -0,0 +1,76 @@
+#include "client_context.h"
+
+#include <iostream>
+
+namespace rest_client {
+
+/** ------ shared client context defination ------ */
+// a plain pthread mutex, so clients may be created during static
+// initialization of other translation units
+static pthread_mutex_t contextMutex = PTHREAD_MUTEX_INITIALIZER;
+static ClientContext* sharedContext = NULL;
+static size_t contextReferences = 0;
+
+ClientContext* ClientContext::acquire() {
+    pthread_mutex_lock(&contextMutex);
+    if (contextReferences++ == 0) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        sharedContext = new ClientContext();
+    }
+    ClientContext* context = sharedContext;
+    pthread_mutex_unlock(&contextMutex);
+    return context;
+}
+
+void ClientContext::release() {
+    pthread_mutex_lock(&contextMutex);
+    if (contextReferences != 0 && --contextReferences == 0) {
+        delete sharedContext;
+        sharedContext = NULL;
+        curl_global_cleanup();
+    }
+    pthread_mutex_unlock(&contextMutex);
+}
+
+ClientContext::ClientContext() {
+    share_ = curl_share_init();
+    if (!share_) {
+        std::cout << "curl_share_init failed, clients do not share caches"
+                  << std::endl;
+        return;
+    }
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) !=
+        CURLSHE_OK) {
+        // libcurl before 7.57 keeps a connection pool per easy handle
+        std::cout << "libcurl can not share connections" << std::endl;
+    }
+}
+
+ClientContext::~ClientContext() {
+    if (share_ && curl_share_cleanup(share_) != CURLSHE_OK) {
+        std::cout << "curl_share_cleanup failed, share still in use"
+                  << std::endl;
+    }
+}
+
+void ClientContext::lockShare(CURL* handle, curl_lock_data data,
+                              curl_lock_access access, void* context) {
+    (void)handle;
+    (void)access;
+    ((ClientContext*)context)->locks_[data].lock();
+}
+
+void ClientContext::unlockShare(CURL* handle, curl_lock_data data,
+                                void* context) {
+    (void)handle;
+    ((ClientContext*)context)->locks_[data].unlock();
+}
+
+/** ------ end shared client context defination ------ */
+
+}  // namespace rest_client
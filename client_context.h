@@ -0,0 +1,62 @@
+#ifndef CLIENT_CONTEXT_H
+#define CLIENT_CONTEXT_H
+
+#include <curl/curl.h>
+
+#include "concurrency.h"
+
+namespace rest_client {
+
+/** ------ shared client context ------ */
+/**
+ * Process wide curl state shared by all RestClient instances.
+ *
+ * The first reference runs curl_global_init and creates a share handle that
+ * holds the DNS cache, the connection pool and the TLS sessions of every
+ * client, so a new client reuses the connections of the clients before it.
+ * The last reference cleans everything up again: a program that creates
+ * short lived clients one after another should hold a ClientContextRef for
+ * its whole run to keep the caches warm.
+ */
+class ClientContext {
+   public:
+    // take a reference, the first one initializes curl
+    static ClientContext *acquire();
+    // drop a reference taken with acquire()
+    static void release();
+
+    // attach to every easy handle again after curl_easy_reset()
+    CURLSH *share() const { return share_; }
+
+   private:
+    ClientContext();
+    ~ClientContext();
+    ClientContext(const ClientContext &);
+    ClientContext &operator=(const ClientContext &);
+
+    static void lockShare(CURL *handle, curl_lock_data data,
+                          curl_lock_access access, void *context);
+    static void unlockShare(CURL *handle, curl_lock_data data, void *context);
+
+    CURLSH *share_;
+    Mutex locks_[CURL_LOCK_DATA_LAST];  // one per kind of shared data
+};
+
+// hold a reference to the shared context for the lifetime of the guard
+class ClientContextRef {
+   public:
+    ClientContextRef() : context_(ClientContext::acquire()) {}
+    ~ClientContextRef() { ClientContext::release(); }
+
+    ClientContext *get() const { return context_; }
+
+   private:
+    ClientContextRef(const ClientContextRef &);
+    ClientContextRef &operator=(const ClientContextRef &);
+    ClientContext *context_;
+};
+
+/** ------ end shared client context ------ */
+
+}  // namespace rest_client
+#endif  // CLIENT_CONTEXT_H
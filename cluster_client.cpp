@@ -0,0 +1,236 @@
+#include "cluster_client.h"
+
+namespace rest_client {
+
+/** ------ cluster client defination ------ */
+bool ClusterClient::Lease::fail() {
+    if (!client_) {
+        return false;
+    }
+    client_->setTimeout(cluster_->options_.pingTimeoutMs);
+    bool alive = client_->pingIoTDB();
+    client_->setTimeout(cluster_->options_.requestTimeoutMs);
+    if (alive) {
+        return true;
+    }
+    cluster_->setHealthy(endpoint_, false);
+    cluster_->discard(endpoint_, client_);
+    client_ = NULL;
+    return false;
+}
+
+void ClusterClient::Lease::release() {
+    if (client_) {
+        cluster_->giveBack(endpoint_, client_);
+        client_ = NULL;
+    }
+}
+
+ClusterClient::ClusterClient(const std::vector<ClusterEndpoint>& endpoints,
+                             const std::string& username,
+                             const std::string& password,
+                             const ClusterOptions& options)
+    : username_(username),
+      password_(password),
+      options_(options),
+      nextQuery_(0),
+      healthThreadStarted_(false),
+      stopping_(false) {
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        Endpoint* endpoint = new Endpoint(endpoints[i]);
+        endpoint->pinger = new RestClient(endpoints[i].ip, endpoints[i].port,
+                                          username_, password_);
+        endpoint->pinger->setTimeout(options_.pingTimeoutMs);
+        endpoints_.push_back(endpoint);
+    }
+    int err = pthread_create(&healthThread_, NULL, runHealthCheck, this);
+    if (err != 0) {
+        // failed requests still take endpoints out of rotation, they only
+        // never come back
+        std::cout << "ClusterClient: pthread_create failed, err=" << err
+                  << ", endpoints are not health checked" << std::endl;
+    } else {
+        healthThreadStarted_ = true;
+    }
+}
+
+ClusterClient::~ClusterClient() {
+    {
+        MutexLock lock(stopMutex_);
+        stopping_ = true;
+        stopCondition_.broadcast();
+    }
+    if (healthThreadStarted_) {
+        pthread_join(healthThread_, NULL);
+    }
+    for (size_t i = 0; i < endpoints_.size(); i++) {
+        Endpoint* endpoint = endpoints_[i];
+        for (size_t j = 0; j < endpoint->idle.size(); j++) {
+            delete endpoint->idle[j];
+        }
+        delete endpoint->pinger;
+        delete endpoint;
+    }
+}
+
+void* ClusterClient::runHealthCheck(void* arg) {
+    ClusterClient& cluster = *(ClusterClient*)arg;
+    while (true) {
+        {
+            MutexLock lock(cluster.stopMutex_);
+            if (!cluster.stopping_) {
+                cluster.stopCondition_.waitFor(cluster.stopMutex_,
+                                               cluster.options_.healthCheckMs);
+            }
+            if (cluster.stopping_) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < cluster.endpoints_.size(); i++) {
+            cluster.setHealthy(i, cluster.endpoints_[i]->pinger->pingIoTDB());
+        }
+    }
+    return NULL;
+}
+
+void ClusterClient::setHealthy(size_t endpoint, bool healthy) {
+    Endpoint& e = *endpoints_[endpoint];
+    if (__atomic_exchange_n(&e.healthy, healthy, __ATOMIC_ACQ_REL) != healthy) {
+        std::cout << "ClusterClient: " << e.address.ip << ":" << e.address.port
+                  << (healthy ? " is up" : " is down") << std::endl;
+    }
+}
+
+void ClusterClient::lease(size_t endpoint, Lease& lease) {
+    lease.release();
+    Endpoint& e = *endpoints_[endpoint];
+    __atomic_fetch_add(&e.outstanding, 1, __ATOMIC_RELAXED);
+    RestClient* client = NULL;
+    {
+        MutexLock lock(e.mutex);
+        if (!e.idle.empty()) {
+            client = e.idle.back();
+            e.idle.pop_back();
+        }
+    }
+    if (!client) {
+        client = new RestClient(e.address.ip, e.address.port, username_,
+                                password_);
+        client->setTimeout(options_.requestTimeoutMs);
+    }
+    lease.cluster_ = this;
+    lease.endpoint_ = endpoint;
+    lease.client_ = client;
+}
+
+void ClusterClient::giveBack(size_t endpoint, RestClient* client) {
+    Endpoint& e = *endpoints_[endpoint];
+    {
+        MutexLock lock(e.mutex);
+        e.idle.push_back(client);
+    }
+    __atomic_fetch_sub(&e.outstanding, 1, __ATOMIC_RELAXED);
+}
+
+void ClusterClient::discard(size_t endpoint, RestClient* client) {
+    // the connection may be broken, do not return it to the pool
+    delete client;
+    __atomic_fetch_sub(&endpoints_[endpoint]->outstanding, 1,
+                       __ATOMIC_RELAXED);
+}
+
+size_t ClusterClient::deviceEndpoint(const std::string& device) const {
+    // stable across processes, so devices keep their node
+    return fnv1a(device.data(), device.size()) % endpoints_.size();
+}
+
+bool ClusterClient::acquireForDevice(const std::string& device,
+                                     Lease& lease) {
+    if (endpoints_.empty()) {
+        return false;
+    }
+    size_t first = deviceEndpoint(device);
+    for (size_t i = 0; i < endpoints_.size(); i++) {
+        size_t endpoint = (first + i) % endpoints_.size();
+        if (isHealthy(endpoint)) {
+            this->lease(endpoint, lease);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ClusterClient::acquireForQuery(Lease& lease) {
+    size_t count = endpoints_.size();
+    size_t first =
+        count == 0 ? 0 : __atomic_fetch_add(&nextQuery_, 1, __ATOMIC_RELAXED);
+    size_t best = count;
+    for (size_t i = 0; i < count; i++) {
+        size_t endpoint = (first + i) % count;
+        if (isHealthy(endpoint) &&
+            (best == count || outstanding(endpoint) < outstanding(best))) {
+            best = endpoint;
+        }
+    }
+    if (best == count) {
+        return false;
+    }
+    this->lease(best, lease);
+    return true;
+}
+
+bool ClusterClient::insertTablet(const Tablet& tablet) {
+    Lease lease;
+    for (size_t attempt = 0; attempt < endpoints_.size(); attempt++) {
+        if (!acquireForDevice(tablet.deviceId, lease)) {
+            break;
+        }
+        if (lease->insertTablet(tablet)) {
+            return true;
+        }
+        if (lease.fail()) {
+            return false;
+        }
+    }
+    std::cout << "ClusterClient: no endpoint accepted the tablet of "
+              << tablet.deviceId << std::endl;
+    return false;
+}
+
+bool ClusterClient::runQuery(const std::string& sql, Json::Value& value) {
+    Lease lease;
+    for (size_t attempt = 0; attempt < endpoints_.size(); attempt++) {
+        if (!acquireForQuery(lease)) {
+            break;
+        }
+        if (lease->runQuery(sql, value)) {
+            return true;
+        }
+        if (lease.fail()) {
+            return false;
+        }
+    }
+    std::cout << "ClusterClient: no endpoint answered the query" << std::endl;
+    return false;
+}
+
+int ClusterClient::runNonQuery(const std::string& sql, std::string& errmesg) {
+    Lease lease;
+    for (size_t attempt = 0; attempt < endpoints_.size(); attempt++) {
+        if (!acquireForQuery(lease)) {
+            break;
+        }
+        int code = lease->runNonQuery(sql, errmesg);
+        // -1 means the request did not get an answer at all
+        if (code != -1 || lease.fail()) {
+            return code;
+        }
+    }
+    std::cout << "ClusterClient: no endpoint answered the statement"
+              << std::endl;
+    return -1;
+}
+
+/** ------ end cluster client defination ------ */
+
+}  // namespace rest_client
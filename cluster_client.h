@@ -0,0 +1,139 @@
+#ifndef CLUSTER_CLIENT_H
+#define CLUSTER_CLIENT_H
+
+#include <string>
+#include <vector>
+
+#include "concurrency.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ cluster client ------ */
+struct ClusterEndpoint {
+    std::string ip;
+    int port;
+
+    ClusterEndpoint(const std::string &ip, int port) : ip(ip), port(port) {}
+};
+
+struct ClusterOptions {
+    uint64_t healthCheckMs;  // pause between two pings of every endpoint
+    long requestTimeoutMs;   // RestClient::setTimeout() of pooled clients
+    long pingTimeoutMs;      // timeout of the health check pings
+
+    ClusterOptions()
+        : healthCheckMs(1000), requestTimeoutMs(30000), pingTimeoutMs(1000) {}
+};
+
+/**
+ * Client for several REST nodes of one IoTDB cluster.
+ *
+ * Every endpoint has a pool of RestClient connections, grown on demand and
+ * safe to use from many threads. Writes go to the endpoint picked by a hash of
+ * the device path, so one device keeps hitting the same node; reads go to the
+ * healthy endpoint with the fewest requests in flight. A background thread
+ * pings every endpoint each healthCheckMs. An endpoint whose ping or request
+ * fails is skipped until a ping succeeds again, and the request is retried on
+ * the next healthy endpoint. Statements sent with runNonQuery() name no
+ * device to hash, so they go to the least loaded endpoint like reads; write
+ * data with insertTablet() to keep it on the node of its device.
+ */
+class ClusterClient {
+   public:
+    /**
+     * A pooled connection of one endpoint, returned to the pool when the
+     * lease goes out of scope. Call fail() if a request failed, which pings
+     * the endpoint and takes it out of rotation if it does not answer.
+     */
+    class Lease {
+       public:
+        Lease() : cluster_(NULL), endpoint_(0), client_(NULL) {}
+        ~Lease() { release(); }
+
+        RestClient *get() const { return client_; }
+        RestClient *operator->() const { return client_; }
+        size_t endpoint() const { return endpoint_; }
+
+        // return true if the endpoint is still alive, i.e. the request was
+        // rejected by the server and retrying elsewhere will not help
+        bool fail();
+        void release();
+
+       private:
+        friend class ClusterClient;
+        Lease(const Lease &);
+        Lease &operator=(const Lease &);
+
+        ClusterClient *cluster_;
+        size_t endpoint_;
+        RestClient *client_;
+    };
+
+    ClusterClient(const std::vector<ClusterEndpoint> &endpoints,
+                  const std::string &username, const std::string &password,
+                  const ClusterOptions &options = ClusterOptions());
+    ~ClusterClient();
+
+    size_t endpointCount() const { return endpoints_.size(); }
+    bool isHealthy(size_t endpoint) const {
+        return __atomic_load_n(&endpoints_[endpoint]->healthy,
+                               __ATOMIC_ACQUIRE);
+    }
+    size_t outstanding(size_t endpoint) const {
+        return __atomic_load_n(&endpoints_[endpoint]->outstanding,
+                               __ATOMIC_RELAXED);
+    }
+
+    // lease a connection for writes of `device`, false if no endpoint is up
+    bool acquireForDevice(const std::string &device, Lease &lease);
+    // lease a connection of the least loaded endpoint for reads
+    bool acquireForQuery(Lease &lease);
+
+    bool insertTablet(const Tablet &tablet);
+    bool runQuery(const std::string &sql, Json::Value &value);
+    // sent to the least loaded endpoint, not the one of a device
+    int runNonQuery(const std::string &sql, std::string &errmesg);
+
+   private:
+    struct Endpoint {
+        ClusterEndpoint address;
+        RestClient *pinger;  // only used by the health check thread
+        Mutex mutex;         // guards idle
+        std::vector<RestClient *> idle;
+        bool healthy;
+        size_t outstanding;
+
+        explicit Endpoint(const ClusterEndpoint &address)
+            : address(address), pinger(NULL), healthy(true), outstanding(0) {}
+    };
+
+    friend class Lease;
+    ClusterClient(const ClusterClient &);
+    ClusterClient &operator=(const ClusterClient &);
+
+    static void *runHealthCheck(void *arg);
+    void lease(size_t endpoint, Lease &lease);
+    void giveBack(size_t endpoint, RestClient *client);
+    void discard(size_t endpoint, RestClient *client);
+    void setHealthy(size_t endpoint, bool healthy);
+    // the endpoint preferred for a device, following ones on failover
+    size_t deviceEndpoint(const std::string &device) const;
+
+    std::vector<Endpoint *> endpoints_;
+    std::string username_;
+    std::string password_;
+    ClusterOptions options_;
+    size_t nextQuery_;  // rotates ties between equally loaded endpoints
+
+    pthread_t healthThread_;
+    bool healthThreadStarted_;  // healthThread_ must be joined
+    Mutex stopMutex_;
+    Condition stopCondition_;
+    bool stopping_;
+};
+
+/** ------ end cluster client ------ */
+
+}  // namespace rest_client
+#endif  // CLUSTER_CLIENT_H
@@ -0,0 +1,346 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cluster_client.h"
+
+// cluster_example [first port]
+//
+// Starts three mock REST nodes on the ports from `first port` on and checks
+// the routing of ClusterClient against them: writes of one device always
+// reach the same node, queries go to the node with the fewest requests in
+// flight, and writes fail over to the next node while their node is down
+// and come back once the health check sees it again. Exits with 0 if every
+// check passed.
+
+#define CHECK(ret, errmsg)                    \
+    do {                                      \
+        if (!(ret)) {                         \
+            std::cout << errmsg << std::endl; \
+            return -1;                        \
+        }                                     \
+    } while (0)
+
+// Answers every request of the client with code 200 and counts the
+// insertTablet requests per device. Connections are served one thread each
+// with keep alive, so stop() looks like a crashed node to the client.
+class MockNode {
+   public:
+    explicit MockNode(int port) : port_(port), listener_(-1), running_(false) {}
+    ~MockNode() { stop(); }
+
+    bool start() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener_ < 0) {
+            return false;
+        }
+        int yes = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port_);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener_, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener_, 16) != 0) {
+            std::cout << "MockNode: can not listen on port " << port_
+                      << std::endl;
+            close(listener_);
+            listener_ = -1;
+            return false;
+        }
+        __atomic_store_n(&running_, true, __ATOMIC_RELEASE);
+        if (pthread_create(&acceptThread_, NULL, runAccept, this) != 0) {
+            __atomic_store_n(&running_, false, __ATOMIC_RELEASE);
+            close(listener_);
+            listener_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    // close the listener and every connection, like a node going down
+    void stop() {
+        if (!__atomic_load_n(&running_, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+        __atomic_store_n(&running_, false, __ATOMIC_RELEASE);
+        pthread_join(acceptThread_, NULL);
+        close(listener_);
+        listener_ = -1;
+        std::vector<pthread_t> connections;
+        {
+            rest_client::MutexLock lock(mutex_);
+            connections.swap(connections_);
+        }
+        for (size_t i = 0; i < connections.size(); i++) {
+            pthread_join(connections[i], NULL);
+        }
+    }
+
+    int port() const { return port_; }
+
+    size_t inserts(const std::string& device) {
+        rest_client::MutexLock lock(mutex_);
+        std::map<std::string, size_t>::iterator it = inserts_.find(device);
+        return it == inserts_.end() ? 0 : it->second;
+    }
+
+   private:
+    struct Connection {
+        MockNode* node;
+        int fd;
+    };
+
+    static void* runAccept(void* arg) {
+        MockNode& node = *(MockNode*)arg;
+        while (__atomic_load_n(&node.running_, __ATOMIC_ACQUIRE)) {
+            struct pollfd ready;
+            ready.fd = node.listener_;
+            ready.events = POLLIN;
+            if (poll(&ready, 1, 20) <= 0) {
+                continue;
+            }
+            int fd = accept(node.listener_, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            Connection* connection = new Connection();
+            connection->node = &node;
+            connection->fd = fd;
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, runConnection, connection) != 0) {
+                close(fd);
+                delete connection;
+                continue;
+            }
+            rest_client::MutexLock lock(node.mutex_);
+            node.connections_.push_back(thread);
+        }
+        return NULL;
+    }
+
+    static void* runConnection(void* arg) {
+        Connection* connection = (Connection*)arg;
+        std::string buffer;
+        while (connection->node->serve(connection->fd, buffer)) {
+        }
+        close(connection->fd);
+        delete connection;
+        return NULL;
+    }
+
+    // read until `buffer` holds `bytes`, false once the peer or the node
+    // went away
+    bool fill(int fd, std::string& buffer, size_t bytes) {
+        char chunk[4096];
+        while (buffer.size() < bytes) {
+            if (!__atomic_load_n(&running_, __ATOMIC_ACQUIRE)) {
+                return false;
+            }
+            struct pollfd ready;
+            ready.fd = fd;
+            ready.events = POLLIN;
+            if (poll(&ready, 1, 20) <= 0) {
+                continue;
+            }
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, n);
+        }
+        return true;
+    }
+
+    // answer one request from `fd`, false to close the connection
+    bool serve(int fd, std::string& buffer) {
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill(fd, buffer, buffer.size() + 1)) {
+                return false;
+            }
+        }
+        std::string header = buffer.substr(0, headerEnd);
+        size_t bodyLength = 0;
+        size_t field = header.find("Content-Length:");
+        if (field == std::string::npos) {
+            field = header.find("content-length:");
+        }
+        if (field != std::string::npos) {
+            bodyLength = strtoul(header.c_str() + field + 15, NULL, 10);
+        }
+        if (!fill(fd, buffer, headerEnd + 4 + bodyLength)) {
+            return false;
+        }
+        std::string body = buffer.substr(headerEnd + 4, bodyLength);
+        buffer.erase(0, headerEnd + 4 + bodyLength);
+
+        std::string path = header.substr(0, header.find("\r\n"));
+        std::string reply = "{\"code\":200,\"message\":\"SUCCESS_STATUS\"}";
+        if (path.find("/insertTablet") != std::string::npos) {
+            Json::Value tablet;
+            Json::CharReaderBuilder builder;
+            std::istringstream in(body);
+            std::string errs;
+            if (Json::parseFromStream(builder, in, &tablet, &errs)) {
+                rest_client::MutexLock lock(mutex_);
+                inserts_[tablet["device"].asString()]++;
+            }
+        } else if (path.find("/query") != std::string::npos) {
+            reply = "{\"expressions\":[],\"timestamps\":[],\"values\":[]}";
+        }
+        std::string response =
+            "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+            "Content-Length: " +
+            rest_client::to_string(reply.size()) + "\r\n\r\n" + reply;
+        return write(fd, response.data(), response.size()) ==
+               (ssize_t)response.size();
+    }
+
+    MockNode(const MockNode&);
+    MockNode& operator=(const MockNode&);
+
+    int port_;
+    int listener_;
+    bool running_;
+    pthread_t acceptThread_;
+    rest_client::Mutex mutex_;  // guards connections_ and inserts_
+    std::vector<pthread_t> connections_;
+    std::map<std::string, size_t> inserts_;
+};
+
+static bool insertOneRow(rest_client::ClusterClient& cluster,
+                         const std::string& device) {
+    std::vector<std::pair<std::string, rest_client::TSDataType> > schemas;
+    schemas.push_back(std::make_pair("s0", rest_client::INT32));
+    rest_client::Tablet tablet(device, schemas, 1);
+    int value = 1;
+    tablet.appendTimestamp(1);
+    tablet.addValue(0, 0, &value);
+    tablet.bitMaps[0].mark(0);
+    return cluster.insertTablet(tablet);
+}
+
+// index of the only node that received inserts of `device`, -1 if there is
+// not exactly one
+static int nodeOf(std::vector<MockNode*>& nodes, const std::string& device) {
+    int found = -1;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i]->inserts(device) != 0) {
+            if (found != -1) return -1;
+            found = (int)i;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char* argv[]) {
+    int firstPort = argc > 1 ? atoi(argv[1]) : 18181;
+    const size_t nodeCount = 3;
+    const size_t deviceCount = 12;
+
+    std::vector<MockNode*> nodes;
+    std::vector<rest_client::ClusterEndpoint> endpoints;
+    for (size_t i = 0; i < nodeCount; i++) {
+        nodes.push_back(new MockNode(firstPort + (int)i));
+        CHECK(nodes[i]->start(), "start mock node failed");
+        endpoints.push_back(
+            rest_client::ClusterEndpoint("127.0.0.1", firstPort + (int)i));
+    }
+    rest_client::ClusterOptions options;
+    options.healthCheckMs = 100;
+    options.pingTimeoutMs = 200;
+    options.requestTimeoutMs = 1000;
+    int ret = -1;
+    {
+        rest_client::ClusterClient cluster(endpoints, "root", "root", options);
+
+        // hash routing: every device sticks to one node, and the devices
+        // spread over more than one node
+        std::vector<std::string> devices;
+        std::vector<int> home;
+        std::vector<bool> used(nodeCount, false);
+        for (size_t i = 0; i < deviceCount; i++) {
+            devices.push_back("root.sg.d" + rest_client::to_string(i));
+            for (int round = 0; round < 3; round++) {
+                CHECK(insertOneRow(cluster, devices[i]), "insert failed");
+            }
+            home.push_back(nodeOf(nodes, devices[i]));
+            CHECK(home[i] != -1, devices[i] << " was sent to several nodes");
+            CHECK(nodes[home[i]]->inserts(devices[i]) == 3,
+                  devices[i] << " lost inserts");
+            used[home[i]] = true;
+        }
+        size_t usedNodes = 0;
+        for (size_t i = 0; i < nodeCount; i++) {
+            if (used[i]) usedNodes++;
+        }
+        CHECK(usedNodes > 1, "all devices were sent to one node");
+        std::cout << "hash routing: " << deviceCount << " devices over "
+                  << usedNodes << " nodes, each on one node" << std::endl;
+
+        // least outstanding: a lease counts as a request in flight, so
+        // holding one lease per node and returning one of them must lead
+        // the next query to exactly that node
+        {
+            rest_client::ClusterClient::Lease leases[3];
+            std::vector<bool> leased(nodeCount, false);
+            for (size_t i = 0; i < nodeCount; i++) {
+                CHECK(cluster.acquireForQuery(leases[i]), "no node for query");
+                leased[leases[i].endpoint()] = true;
+            }
+            for (size_t i = 0; i < nodeCount; i++) {
+                CHECK(leased[i], "node " << i << " got no query lease");
+            }
+            size_t freed = leases[1].endpoint();
+            leases[1].release();
+            rest_client::ClusterClient::Lease next;
+            CHECK(cluster.acquireForQuery(next), "no node for query");
+            CHECK(next.endpoint() == freed,
+                  "query went to node " << next.endpoint() << " instead of "
+                                        << freed);
+            Json::Value result;
+            CHECK(next->runQuery("select s0 from root.sg.d0", result),
+                  "query failed");
+        }
+        std::cout << "least outstanding: query routed to the idle node"
+                  << std::endl;
+
+        // failover: writes of a device whose node is down go to another
+        // node, and come back once the health check sees the node again
+        const std::string& device = devices[0];
+        MockNode& down = *nodes[home[0]];
+        down.stop();
+        size_t before = down.inserts(device);
+        CHECK(insertOneRow(cluster, device), "insert during failover failed");
+        CHECK(!cluster.isHealthy(home[0]), "stopped node still healthy");
+        size_t elsewhere = 0;
+        for (size_t i = 0; i < nodeCount; i++) {
+            if ((int)i != home[0]) elsewhere += nodes[i]->inserts(device);
+        }
+        CHECK(elsewhere == 1, "insert was not failed over");
+        std::cout << "failover: " << device << " written to another node"
+                  << " while node " << home[0] << " is down" << std::endl;
+
+        CHECK(down.start(), "restart mock node failed");
+        for (int wait = 0; wait < 50 && !cluster.isHealthy(home[0]); wait++) {
+            usleep(100 * 1000);
+        }
+        CHECK(cluster.isHealthy(home[0]), "restarted node not healthy");
+        CHECK(insertOneRow(cluster, device), "insert after recovery failed");
+        CHECK(down.inserts(device) == before + 1,
+              "device did not return to its node");
+        std::cout << "recovery: " << device << " back on node " << home[0]
+                  << std::endl;
+        ret = 0;
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        delete nodes[i];
+    }
+    return ret;
+}
@@ -0,0 +1,257 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <deque>
+
+namespace rest_client {
+
+/** ------ mutex and condition ------ */
+class Mutex {
+   public:
+    Mutex() { pthread_mutex_init(&mutex_, NULL); }
+    ~Mutex() { pthread_mutex_destroy(&mutex_); }
+
+    void lock() { pthread_mutex_lock(&mutex_); }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+
+   private:
+    friend class Condition;
+    Mutex(const Mutex &);
+    Mutex &operator=(const Mutex &);
+    pthread_mutex_t mutex_;
+};
+
+// hold `mutex` for the lifetime of the guard
+class MutexLock {
+   public:
+    explicit MutexLock(Mutex &mutex) : mutex_(mutex) { mutex_.lock(); }
+    ~MutexLock() { mutex_.unlock(); }
+
+   private:
+    MutexLock(const MutexLock &);
+    MutexLock &operator=(const MutexLock &);
+    Mutex &mutex_;
+};
+
+class Condition {
+   public:
+    Condition() { pthread_cond_init(&cond_, NULL); }
+    ~Condition() { pthread_cond_destroy(&cond_); }
+
+    // `mutex` must be held by the caller
+    void wait(Mutex &mutex) { pthread_cond_wait(&cond_, &mutex.mutex_); }
+    // like wait(), but give up after `ms` milliseconds; false on timeout
+    bool waitFor(Mutex &mutex, uint64_t ms) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        return pthread_cond_timedwait(&cond_, &mutex.mutex_, &deadline) !=
+               ETIMEDOUT;
+    }
+    void signal() { pthread_cond_signal(&cond_); }
+    void broadcast() { pthread_cond_broadcast(&cond_); }
+
+   private:
+    Condition(const Condition &);
+    Condition &operator=(const Condition &);
+    pthread_cond_t cond_;
+};
+
+/** ------ end mutex and condition ------ */
+
+/** ------ blocking queue ------ */
+// Bounded FIFO handing work between threads. push() blocks while the queue
+// is full, pop() blocks while it is empty, and close() releases everybody.
+template <typename T>
+class BlockingQueue {
+   public:
+    explicit BlockingQueue(size_t capacity)
+        : capacity_(capacity == 0 ? 1 : capacity), closed_(false) {}
+
+    // return false if the queue was closed, `item` is not queued then
+    bool push(const T &item) {
+        MutexLock lock(mutex_);
+        while (items_.size() >= capacity_ && !closed_) {
+            notFull_.wait(mutex_);
+        }
+        if (closed_) return false;
+        items_.push_back(item);
+        notEmpty_.signal();
+        return true;
+    }
+
+    // return false once the queue is closed and drained
+    bool pop(T &item) {
+        MutexLock lock(mutex_);
+        while (items_.empty() && !closed_) {
+            notEmpty_.wait(mutex_);
+        }
+        if (items_.empty()) return false;
+        item = items_.front();
+        items_.pop_front();
+        notFull_.signal();
+        return true;
+    }
+
+    void close() {
+        MutexLock lock(mutex_);
+        closed_ = true;
+        notEmpty_.broadcast();
+        notFull_.broadcast();
+    }
+
+   private:
+    BlockingQueue(const BlockingQueue &);
+    BlockingQueue &operator=(const BlockingQueue &);
+
+    size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    Mutex mutex_;
+    Condition notEmpty_;
+    Condition notFull_;
+};
+
+/** ------ end blocking queue ------ */
+
+/** ------ lock free mpsc queue ------ */
+// Intrusive multi producer single consumer queue (Vyukov). Nodes are linked
+// through their `next` member; push() is wait free and may be called from
+// any thread, pop() only from the one consumer. pop() may transiently see
+// the queue empty while a push is half done, the node shows up on a later
+// pop().
+template <typename T>
+class MpscQueue {
+   public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) { stub_.next = NULL; }
+
+    void push(T *node) {
+        node->next = NULL;
+        T *prev = __atomic_exchange_n(&head_, node, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    }
+
+    T *pop() {
+        T *tail = tail_;
+        T *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (tail == &stub_) {
+            if (!next) return NULL;
+            tail_ = next;
+            tail = next;
+            next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != __atomic_load_n(&head_, __ATOMIC_ACQUIRE)) return NULL;
+        push(&stub_);
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return NULL;
+    }
+
+   private:
+    MpscQueue(const MpscQueue &);
+    MpscQueue &operator=(const MpscQueue &);
+
+    T *head_;  // last pushed node, written by producers
+    char pad_[64 - sizeof(T *)];
+    T *tail_;  // next node to pop, owned by the consumer
+    T stub_;
+};
+
+/** ------ end lock free mpsc queue ------ */
+
+/** ------ lock free node pool ------ */
+// Fixed array of preallocated nodes with a lock free free list, so queue
+// nodes are recycled instead of going through the allocator per item. Any
+// thread may allocate() and release(); the head carries a tag that changes
+// on every update, so a pop never succeeds on a head that was popped and
+// pushed back in between. Once the array is used up allocate() falls back
+// to new, release() tells such nodes apart by address and deletes them.
+template <typename T>
+class NodePool {
+   public:
+    explicit NodePool(size_t capacity)
+        : capacity_(capacity < 0xffffffffu ? capacity : 0xfffffffeu),
+          nodes_(new T[capacity_]),
+          links_(new uint32_t[capacity_]),
+          head_(0) {
+        // free list of indexes plus one, 0 ends it
+        for (size_t i = 0; i < capacity_; i++) {
+            links_[i] = i + 1 < capacity_ ? (uint32_t)(i + 2) : 0;
+        }
+        head_ = capacity_ != 0 ? 1 : 0;
+    }
+    ~NodePool() {
+        delete[] nodes_;
+        delete[] links_;
+    }
+
+    T *allocate() {
+        uint64_t head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+        while (true) {
+            uint32_t index = (uint32_t)head;
+            if (index == 0) return new T();
+            uint32_t next =
+                __atomic_load_n(&links_[index - 1], __ATOMIC_RELAXED);
+            uint64_t update = nextTag(head) | next;
+            if (__atomic_compare_exchange_n(&head_, &head, update, true,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                return &nodes_[index - 1];
+            }
+        }
+    }
+
+    void release(T *node) {
+        if (node < nodes_ || node >= nodes_ + capacity_) {
+            delete node;
+            return;
+        }
+        uint32_t index = (uint32_t)(node - nodes_) + 1;
+        uint64_t head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+        while (true) {
+            __atomic_store_n(&links_[index - 1], (uint32_t)head,
+                             __ATOMIC_RELAXED);
+            uint64_t update = nextTag(head) | index;
+            if (__atomic_compare_exchange_n(&head_, &head, update, true,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+                return;
+            }
+        }
+    }
+
+   private:
+    NodePool(const NodePool &);
+    NodePool &operator=(const NodePool &);
+
+    static uint64_t nextTag(uint64_t head) {
+        return ((head >> 32) + 1) << 32;
+    }
+
+    size_t capacity_;
+    T *nodes_;
+    uint32_t *links_;  // next free index plus one of every free node
+    uint64_t head_;    // tag << 32 | first free index plus one
+};
+
+/** ------ end lock free node pool ------ */
+
+}  // namespace rest_client
+#endif  // CONCURRENCY_H
@@ -0,0 +1,37 @@
+#include <stdlib.h>
+
+#include "csv_importer.h"
+
+// csv_import <file> [ip] [port] [username] [password] [parse threads]
+//            [connections]
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "usage: " << argv[0]
+                  << " <file> [ip] [port] [username] [password]"
+                     " [parse threads] [connections]"
+                  << std::endl;
+        return -1;
+    }
+    std::string ip = argc > 2 ? argv[2] : "127.0.0.1";
+    int port = argc > 3 ? atoi(argv[3]) : 18080;
+    std::string username = argc > 4 ? argv[4] : "root";
+    std::string password = argc > 5 ? argv[5] : "root";
+    rest_client::CsvImportOptions options;
+    if (argc > 6) options.parseThreads = atoi(argv[6]);
+    size_t connections = argc > 7 ? atoi(argv[7]) : 4;
+
+    std::vector<rest_client::RestClient*> clients;
+    for (size_t i = 0; i < connections; i++) {
+        clients.push_back(
+            new rest_client::RestClient(ip, port, username, password));
+    }
+    rest_client::CsvImportResult result;
+    bool ok = rest_client::importCsv(argv[1], clients, options, &result);
+    std::cout << "imported " << result.rows << " rows in " << result.tablets
+              << " tablets, " << result.badLines << " bad lines, "
+              << result.failedTablets << " failed tablets" << std::endl;
+    for (size_t i = 0; i < clients.size(); i++) {
+        delete clients[i];
+    }
+    return ok ? 0 : -1;
+}
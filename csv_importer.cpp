@@ -0,0 +1,490 @@
+#include "csv_importer.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "concurrency.h"
+#include "trace.h"
+
+namespace rest_client {
+
+/** ------ csv importer defination ------ */
+struct CsvDevice {
+    std::string deviceId;
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    std::vector<size_t> textColumns;  // csv columns of the TEXT schemas
+};
+
+struct CsvColumn {
+    size_t device;
+    size_t schemaId;
+};
+
+struct CsvField {
+    const char* begin;
+    const char* end;
+    bool quoted;
+};
+
+struct CsvImportJob {
+    const std::vector<CsvDevice>* devices;
+    const std::vector<CsvColumn>* columns;
+    const CsvImportOptions* options;
+    BlockingQueue<Tablet*>* queue;
+    const char* begin;
+    const char* end;
+    size_t rows;
+    size_t badLines;
+};
+
+struct CsvImportSender {
+    RestClient* client;
+    BlockingQueue<Tablet*>* queue;
+    AdaptiveBatchController* controller;
+    size_t tablets;
+    size_t failed;
+};
+
+static bool parseCsvInt64(const char* begin, const char* end,
+                          int64_t& value) {
+    bool negative = false;
+    if (begin != end && (*begin == '-' || *begin == '+')) {
+        negative = *begin == '-';
+        begin++;
+    }
+    if (begin == end) return false;
+    // the magnitude of the minimum is one more than the maximum
+    uint64_t limit =
+        (uint64_t)std::numeric_limits<int64_t>::max() + (negative ? 1 : 0);
+    uint64_t magnitude = 0;
+    for (; begin != end; begin++) {
+        if (*begin < '0' || *begin > '9') return false;
+        unsigned digit = *begin - '0';
+        if (magnitude > (limit - digit) / 10) return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+static bool parseCsvDouble(const char* begin, const char* end,
+                           double& value) {
+    char buf[64];
+    size_t length = end - begin;
+    if (length == 0 || length >= sizeof(buf)) return false;
+    memcpy(buf, begin, length);
+    buf[length] = '\0';
+    char* parsed;
+    value = strtod(buf, &parsed);
+    return parsed == buf + length;
+}
+
+static bool parseCsvBool(const char* begin, const char* end, bool& value) {
+    size_t length = end - begin;
+    if ((length == 4 && strncasecmp(begin, "true", 4) == 0) ||
+        (length == 1 && *begin == '1')) {
+        value = true;
+    } else if ((length == 5 && strncasecmp(begin, "false", 5) == 0) ||
+               (length == 1 && *begin == '0')) {
+        value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// split one line into `fields`, return false on an unterminated quote
+static bool splitCsvLine(const char* begin, const char* end,
+                         std::vector<CsvField>& fields) {
+    fields.clear();
+    const char* p = begin;
+    while (true) {
+        CsvField field;
+        field.quoted = p != end && *p == '"';
+        if (field.quoted) {
+            field.begin = ++p;
+            while (true) {
+                if (p == end) return false;
+                if (*p == '"') {
+                    if (p + 1 != end && p[1] == '"') {
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                p++;
+            }
+            field.end = p++;
+        } else {
+            field.begin = p;
+            while (p != end && *p != ',') p++;
+            field.end = p;
+        }
+        fields.push_back(field);
+        if (p == end) return true;
+        if (*p != ',') return false;
+        p++;
+    }
+}
+
+static bool storeCsvValue(Tablet& tablet, size_t schemaId, size_t row,
+                          const CsvField& field) {
+    switch (tablet.schemas[schemaId].second) {
+        case BOOLEAN:
+            return parseCsvBool(field.begin, field.end,
+                                ((bool*)tablet.values[schemaId])[row]);
+        case INT32: {
+            int64_t value;
+            if (!parseCsvInt64(field.begin, field.end, value) ||
+                value != (int)value) {
+                return false;
+            }
+            ((int*)tablet.values[schemaId])[row] = (int)value;
+            return true;
+        }
+        case INT64:
+            return parseCsvInt64(field.begin, field.end,
+                                 ((int64_t*)tablet.values[schemaId])[row]);
+        case FLOAT: {
+            double value;
+            if (!parseCsvDouble(field.begin, field.end, value)) return false;
+            ((float*)tablet.values[schemaId])[row] = (float)value;
+            return true;
+        }
+        case DOUBLE:
+            return parseCsvDouble(field.begin, field.end,
+                                  ((double*)tablet.values[schemaId])[row]);
+        case TEXT:
+            // stored by storeCsvText() once the row was appended
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void storeCsvText(Tablet& tablet, size_t schemaId, size_t row,
+                         const CsvField& field) {
+    if (!field.quoted ||
+        std::search(field.begin, field.end, "\"\"", "\"\"" + 2) == field.end) {
+        tablet.addText(schemaId, row, field.begin, field.end - field.begin);
+        return;
+    }
+    std::string value;
+    for (const char* p = field.begin; p != field.end; p++) {
+        value += *p;
+        if (*p == '"') p++;
+    }
+    tablet.addText(schemaId, row, value.data(), value.size());
+}
+
+static bool parseCsvHeader(const char* begin, const char* end,
+                           std::vector<CsvDevice>& devices,
+                           std::vector<CsvColumn>& columns) {
+    std::vector<CsvField> fields;
+    if (!splitCsvLine(begin, end, fields) || fields.size() < 2) {
+        std::cout << "csv header needs a time column and at least one series"
+                  << std::endl;
+        return false;
+    }
+    std::map<std::string, size_t> deviceIndex;
+    for (size_t i = 1; i < fields.size(); i++) {
+        std::string name(fields[i].begin, fields[i].end);
+        size_t open = name.rfind('(');
+        size_t dot = name.rfind('.', open);
+        TSDataType type;
+        if (open == std::string::npos || name[name.size() - 1] != ')' ||
+            dot == std::string::npos ||
+            !StringToDatatype(name.substr(open + 1, name.size() - open - 2),
+                              type)) {
+            std::cout << "csv header column should look like "
+                         "root.sg.d1.s1(INT32): "
+                      << name << std::endl;
+            return false;
+        }
+        std::string deviceId = name.substr(0, dot);
+        std::map<std::string, size_t>::iterator it =
+            deviceIndex.find(deviceId);
+        if (it == deviceIndex.end()) {
+            it = deviceIndex.insert(std::make_pair(deviceId, devices.size()))
+                     .first;
+            devices.push_back(CsvDevice());
+            devices.back().deviceId = deviceId;
+        }
+        CsvDevice& device = devices[it->second];
+        CsvColumn column;
+        column.device = it->second;
+        column.schemaId = device.schemas.size();
+        if (type == TEXT) {
+            device.textColumns.push_back(columns.size());
+        }
+        columns.push_back(column);
+        device.schemas.push_back(
+            std::make_pair(name.substr(dot + 1, open - dot - 1), type));
+    }
+    return true;
+}
+
+static void* parseCsvRange(void* arg) {
+    CsvImportJob* job = (CsvImportJob*)arg;
+    TraceSpan span("csv.parse");
+    span.setBytes(job->end - job->begin);
+    const std::vector<CsvDevice>& devices = *job->devices;
+    const std::vector<CsvColumn>& columns = *job->columns;
+    std::vector<Tablet*> tablets(devices.size(), (Tablet*)NULL);
+    std::vector<bool> touched(devices.size());
+    std::vector<CsvField> fields;
+
+    const char* line = job->begin;
+    while (line < job->end) {
+        const char* lineEnd =
+            (const char*)memchr(line, '\n', job->end - line);
+        if (!lineEnd) lineEnd = job->end;
+        const char* next = lineEnd + 1;
+        if (lineEnd != line && lineEnd[-1] == '\r') lineEnd--;
+        if (lineEnd == line) {
+            line = next;
+            continue;
+        }
+
+        int64_t timestamp;
+        if (!splitCsvLine(line, lineEnd, fields) ||
+            fields.size() != columns.size() + 1 ||
+            !parseCsvInt64(fields[0].begin, fields[0].end, timestamp)) {
+            job->badLines++;
+            line = next;
+            continue;
+        }
+
+        std::fill(touched.begin(), touched.end(), false);
+        bool valid = true;
+        for (size_t i = 0; i < columns.size() && valid; i++) {
+            const CsvField& field = fields[i + 1];
+            if (field.begin == field.end && !field.quoted) {
+                continue;
+            }
+            const CsvColumn& column = columns[i];
+            Tablet*& tablet = tablets[column.device];
+            if (!tablet) {
+                tablet = new Tablet(devices[column.device].deviceId,
+                                    devices[column.device].schemas,
+                                    job->options->tabletRows,
+                                    job->options->isAligned);
+                tablet->setTimestampCompression(
+                    job->options->compressTimestamps);
+            }
+            touched[column.device] = true;
+            valid = storeCsvValue(*tablet, column.schemaId, tablet->rowSize,
+                                  field);
+            tablet->bitMaps[column.schemaId].mark(tablet->rowSize);
+        }
+
+        for (size_t d = 0; d < devices.size(); d++) {
+            if (!touched[d]) continue;
+            Tablet* tablet = tablets[d];
+            if (!valid) {
+                for (size_t i = 0; i < devices[d].schemas.size(); i++) {
+                    tablet->bitMaps[i].unmark(tablet->rowSize);
+                }
+                continue;
+            }
+            tablet->appendTimestamp(timestamp);
+            for (size_t i = 0; i < devices[d].textColumns.size(); i++) {
+                size_t c = devices[d].textColumns[i];
+                const CsvField& field = fields[c + 1];
+                if (field.begin != field.end || field.quoted) {
+                    storeCsvText(*tablet, columns[c].schemaId,
+                                 tablet->rowSize - 1, field);
+                }
+            }
+            AdaptiveBatchController* controller =
+                job->options->batchController;
+            if (tablet->rowSize == tablet->maxRowNumber ||
+                (controller && tablet->rowSize >= controller->targetRows())) {
+                // a long push means the senders are the bottleneck
+                TraceSpan pushSpan("csv.queue_push");
+                pushSpan.setDevice(tablet->deviceId);
+                pushSpan.setRows(tablet->rowSize);
+                job->queue->push(tablet);
+                tablets[d] = NULL;
+            }
+        }
+        if (valid) {
+            job->rows++;
+        } else {
+            job->badLines++;
+        }
+        line = next;
+    }
+
+    for (size_t d = 0; d < devices.size(); d++) {
+        if (tablets[d] && tablets[d]->rowSize != 0) {
+            job->queue->push(tablets[d]);
+        } else {
+            delete tablets[d];
+        }
+    }
+    span.setRows(job->rows);
+    return NULL;
+}
+
+static void* sendCsvTablets(void* arg) {
+    CsvImportSender* sender = (CsvImportSender*)arg;
+    Tablet* tablet;
+    while (sender->queue->pop(tablet)) {
+        sender->tablets++;
+        uint64_t sentAt = monotonicMicros();
+        bool ok = sender->client->insertTablet(*tablet);
+        if (sender->controller) {
+            sender->controller->onRequest(tablet->rowSize,
+                                          monotonicMicros() - sentAt, ok);
+        }
+        if (!ok) {
+            sender->failed++;
+        }
+        delete tablet;
+    }
+    return NULL;
+}
+
+bool importCsv(const std::string& path,
+               const std::vector<RestClient*>& clients,
+               const CsvImportOptions& options, CsvImportResult* result) {
+    CsvImportResult total;
+    total.rows = 0;
+    total.badLines = 0;
+    total.tablets = 0;
+    total.failedTablets = 0;
+    if (result) {
+        *result = total;
+    }
+    if (clients.empty() || options.tabletRows == 0) {
+        std::cout << "importCsv() needs a client and a positive tablet size"
+                  << std::endl;
+        return false;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "open csv file failed: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cout << "empty csv file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t length = st.st_size;
+    void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cout << "mmap csv file failed: " << path << std::endl;
+        return false;
+    }
+    const char* data = (const char*)mapped;
+    const char* end = data + length;
+
+    const char* headerEnd = (const char*)memchr(data, '\n', length);
+    if (!headerEnd) headerEnd = end;
+    const char* body = headerEnd == end ? end : headerEnd + 1;
+    if (headerEnd != data && headerEnd[-1] == '\r') headerEnd--;
+    std::vector<CsvDevice> devices;
+    std::vector<CsvColumn> columns;
+    if (!parseCsvHeader(data, headerEnd, devices, columns)) {
+        munmap(mapped, length);
+        return false;
+    }
+
+    BlockingQueue<Tablet*> queue(options.queueDepth);
+    std::vector<CsvImportSender> senders(clients.size());
+    std::vector<pthread_t> senderThreads(clients.size());
+    size_t started = 0;
+    for (size_t i = 0; i < clients.size(); i++) {
+        senders[i].client = clients[i];
+        senders[i].queue = &queue;
+        senders[i].controller = options.batchController;
+        senders[i].tablets = 0;
+        senders[i].failed = 0;
+        if (pthread_create(&senderThreads[i], NULL, sendCsvTablets,
+                           &senders[i]) != 0) {
+            std::cout << "importCsv() could not start sender " << i
+                      << std::endl;
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        munmap(mapped, length);
+        return false;
+    }
+
+    size_t parseThreads = options.parseThreads == 0 ? 1 : options.parseThreads;
+    std::vector<CsvImportJob> jobs;
+    const char* begin = body;
+    for (size_t i = 1; i <= parseThreads && begin < end; i++) {
+        const char* split = body + (end - body) * i / parseThreads;
+        if (split < begin) split = begin;
+        const char* newline = (const char*)memchr(split, '\n', end - split);
+        const char* rangeEnd = newline ? newline + 1 : end;
+        if (i == parseThreads) rangeEnd = end;
+        CsvImportJob job;
+        job.devices = &devices;
+        job.columns = &columns;
+        job.options = &options;
+        job.queue = &queue;
+        job.begin = begin;
+        job.end = rangeEnd;
+        job.rows = 0;
+        job.badLines = 0;
+        jobs.push_back(job);
+        begin = rangeEnd;
+    }
+    std::vector<pthread_t> parseThreadIds(jobs.size());
+    std::vector<bool> parsing(jobs.size(), false);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (pthread_create(&parseThreadIds[i], NULL, parseCsvRange,
+                           &jobs[i]) != 0) {
+            std::cout << "importCsv() could not start parser " << i
+                      << ", parsing its range on the calling thread"
+                      << std::endl;
+            continue;
+        }
+        parsing[i] = true;
+    }
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!parsing[i]) {
+            parseCsvRange(&jobs[i]);
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (parsing[i]) {
+            pthread_join(parseThreadIds[i], NULL);
+        }
+        total.rows += jobs[i].rows;
+        total.badLines += jobs[i].badLines;
+    }
+    queue.close();
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(senderThreads[i], NULL);
+        total.tablets += senders[i].tablets;
+        total.failedTablets += senders[i].failed;
+    }
+    munmap(mapped, length);
+
+    if (result) {
+        *result = total;
+    }
+    return total.badLines == 0 && total.failedTablets == 0;
+}
+
+/** ------ end csv importer defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,62 @@
+#ifndef CSV_IMPORTER_H
+#define CSV_IMPORTER_H
+
+#include <string>
+#include <vector>
+
+#include "adaptive_batch.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ csv importer ------ */
+struct CsvImportOptions {
+    size_t parseThreads;  // byte ranges parsed in parallel
+    size_t tabletRows;    // rows per tablet sent with insertTablet
+    size_t queueDepth;    // full tablets waiting for a sender
+    bool isAligned;
+    bool compressTimestamps;  // Tablet::setTimestampCompression() of tablets
+    // when set, tablets are cut at its current setpoint, at most tabletRows
+    AdaptiveBatchController *batchController;
+
+    CsvImportOptions()
+        : parseThreads(4),
+          tabletRows(1024),
+          queueDepth(16),
+          isAligned(false),
+          compressTimestamps(false),
+          batchController(NULL) {}
+};
+
+struct CsvImportResult {
+    size_t rows;           // csv lines imported
+    size_t badLines;       // lines skipped because they could not be parsed
+    size_t tablets;        // tablets sent
+    size_t failedTablets;  // tablets the server rejected
+};
+
+/**
+ * Import a csv file in the layout written by IoTDB's export tool:
+ *
+ *   Time,root.sg.d1.s1(INT32),root.sg.d1.s2(DOUBLE),root.sg.d2.s1(TEXT)
+ *   1000,1,0.5,"on"
+ *   1001,,0.7,
+ *
+ * Time must be an integer timestamp, an empty field is a null value and
+ * TEXT fields may be quoted with "" as escaped quote, but must not span
+ * lines. The file is mapped and split into `parseThreads` byte ranges on
+ * line boundaries. Each range is parsed straight into one Tablet per device,
+ * and full tablets are handed through a bounded queue to one sender thread
+ * per client.
+ *
+ * Return false if the file could not be read or anything was rejected.
+ */
+bool importCsv(const std::string &path,
+               const std::vector<RestClient *> &clients,
+               const CsvImportOptions &options,
+               CsvImportResult *result = NULL);
+
+/** ------ end csv importer ------ */
+
+}  // namespace rest_client
+#endif  // CSV_IMPORTER_H
@@ -0,0 +1,62 @@
+#include "device_query.h"
+
+namespace rest_client {
+
+/** ------ align by device query defination ------ */
+std::string DeviceQuery::toSql() const {
+    std::ostringstream oss;
+    oss << "select ";
+    for (size_t i = 0; i < measurements.size(); i++) {
+        oss << (i == 0 ? "" : ", ") << measurements[i].first;
+    }
+    oss << " from " << from;
+    std::vector<std::string> conditions;
+    if (begin != std::numeric_limits<int64_t>::min()) {
+        std::ostringstream condition;
+        condition << "time >= " << begin;
+        conditions.push_back(condition.str());
+    }
+    if (end != std::numeric_limits<int64_t>::max()) {
+        std::ostringstream condition;
+        condition << "time < " << end;
+        conditions.push_back(condition.str());
+    }
+    if (!predicate.empty()) {
+        conditions.push_back("(" + predicate + ")");
+    }
+    for (size_t i = 0; i < conditions.size(); i++) {
+        oss << (i == 0 ? " where " : " and ") << conditions[i];
+    }
+    // the grammar wants the pagination before the align clause
+    if (limit != 0) oss << " limit " << limit;
+    if (offset != 0) oss << " offset " << offset;
+    if (slimit != 0) oss << " slimit " << slimit;
+    if (soffset != 0) oss << " soffset " << soffset;
+    oss << " align by device";
+    return oss.str();
+}
+
+const Tablet* DeviceTablets::find(const std::string& device) const {
+    for (size_t i = 0; i < tablets_.size(); i++) {
+        if (tablets_[i]->deviceId == device) {
+            return tablets_[i];
+        }
+    }
+    return NULL;
+}
+
+Tablet& DeviceTablets::add() {
+    tablets_.push_back(new Tablet());
+    return *tablets_.back();
+}
+
+void DeviceTablets::clear() {
+    for (size_t i = 0; i < tablets_.size(); i++) {
+        delete tablets_[i];
+    }
+    tablets_.clear();
+}
+
+/** ------ end align by device query defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,71 @@
+#ifndef DEVICE_QUERY_H
+#define DEVICE_QUERY_H
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ align by device query ------ */
+/**
+ * One "align by device" statement over many devices, e.g.
+ *
+ *   select s1, s2 from root.sg.* where time >= 0 and time < 100
+ *       and s1 > 10 limit 1000 slimit 10 align by device
+ *
+ * `predicate` is pushed to the server as is and may refer to the selected
+ * measurements. The LIMIT/OFFSET and SLIMIT/SOFFSET clauses are only written
+ * when not 0 and keep the meaning the server gives them for align by device.
+ */
+struct DeviceQuery {
+    std::string from;  // path pattern of the devices, e.g. "root.sg.*"
+    std::vector<std::pair<std::string, TSDataType> > measurements;
+    int64_t begin;  // "time >= begin" unless the smallest int64_t
+    int64_t end;    // "time < end" unless the largest int64_t
+    std::string predicate;
+    size_t limit;
+    size_t offset;
+    size_t slimit;
+    size_t soffset;
+
+    DeviceQuery()
+        : begin(std::numeric_limits<int64_t>::min()),
+          end(std::numeric_limits<int64_t>::max()),
+          limit(0),
+          offset(0),
+          slimit(0),
+          soffset(0) {}
+
+    std::string toSql() const;
+};
+
+// The per device Tablets of an align by device result, owned by the result.
+class DeviceTablets {
+   public:
+    DeviceTablets() {}
+    ~DeviceTablets() { clear(); }
+
+    size_t size() const { return tablets_.size(); }
+    const Tablet &operator[](size_t index) const { return *tablets_[index]; }
+    Tablet &operator[](size_t index) { return *tablets_[index]; }
+    // NULL if the result has no rows of `device`
+    const Tablet *find(const std::string &device) const;
+
+    // append an empty tablet, owned by this result
+    Tablet &add();
+    void clear();
+
+   private:
+    DeviceTablets(const DeviceTablets &);
+    DeviceTablets &operator=(const DeviceTablets &);
+
+    std::vector<Tablet *> tablets_;
+};
+
+/** ------ end align by device query ------ */
+
+}  // namespace rest_client
+#endif  // DEVICE_QUERY_H
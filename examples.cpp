@@ -90,4 +90,15 @@ int main() {
                  "query timeseries latest value failed");
     std::cout<<"query timeseries latest value success"<<std::endl;
     std::cout << "timestamp: " << timestamp << ", value: " << last_value << std::endl;
+
+    std::vector<rest_client::AggregationType> aggregations;
+    aggregations.push_back(rest_client::AVG);
+    aggregations.push_back(rest_client::COUNT);
+    rest_client::Tablet aggregated;
+    FAILED_EXIST(client.queryAggregation("root.sg1.d2", "s1",
+                                         rest_client::INT32, aggregations, 0,
+                                         100, 10, aggregated),
+                 "query aggregation failed");
+    std::cout << "query aggregation success" << std::endl;
+    std::cout << aggregated.toJson();
 }
@@ -0,0 +1,396 @@
+#include "ingestion_service.h"
+
+#include <string.h>
+
+#include "trace.h"
+
+namespace rest_client {
+
+/** ------ ingestion service defination ------ */
+const IngestionService::SeriesId IngestionService::INVALID_SERIES;
+
+IngestionService::IngestionService(const std::vector<RestClient*>& clients,
+                                   const IngestionOptions& options)
+    : options_(options), seriesCount_(0), running_(true) {
+    if (options_.maxRows == 0) options_.maxRows = 1;
+    series_.resize(options_.maxSeries);
+    for (size_t i = 0; i < clients.size(); i++) {
+        Shard* shard = new Shard(options_.queuedPoints);
+        shard->service = this;
+        shard->client = clients[i];
+        shard->stats.points = 0;
+        shard->stats.rejected = 0;
+        shard->stats.tablets = 0;
+        shard->stats.failedTablets = 0;
+        // no series is registered yet, so a client without a sender thread
+        // is simply left out of the sharding
+        int err = pthread_create(&shard->thread, NULL, runShard, shard);
+        if (err != 0) {
+            std::cout << "IngestionService: pthread_create failed, err="
+                      << err << ", client " << i << " is not used"
+                      << std::endl;
+            delete shard;
+            continue;
+        }
+        shards_.push_back(shard);
+    }
+}
+
+IngestionService::~IngestionService() {
+    close();
+    for (size_t i = 0; i < shards_.size(); i++) {
+        delete shards_[i];
+    }
+}
+
+void IngestionService::close() {
+    if (!__atomic_load_n(&running_, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    __atomic_store_n(&running_, false, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < shards_.size(); i++) {
+        MutexLock lock(shards_[i]->mutex);
+        shards_[i]->wakeup.signal();
+    }
+    for (size_t i = 0; i < shards_.size(); i++) {
+        pthread_join(shards_[i]->thread, NULL);
+    }
+}
+
+IngestionService::SeriesId IngestionService::registerSeries(
+    const std::string& device, const std::string& measurement,
+    TSDataType type) {
+    if (shards_.empty()) {
+        return INVALID_SERIES;
+    }
+    MutexLock lock(registryMutex_);
+    std::string path = device + "." + measurement;
+    std::map<std::string, SeriesId>::iterator it = seriesIndex_.find(path);
+    if (it != seriesIndex_.end()) {
+        return series_[it->second].type == type ? it->second : INVALID_SERIES;
+    }
+    if (seriesCount_ == series_.size()) {
+        std::cout << "IngestionService: too many series, raise maxSeries"
+                  << std::endl;
+        return INVALID_SERIES;
+    }
+
+    std::map<std::string, size_t>::iterator deviceIt =
+        deviceIndex_.find(device);
+    if (deviceIt == deviceIndex_.end()) {
+        deviceIt =
+            deviceIndex_.insert(std::make_pair(device, deviceIndex_.size()))
+                .first;
+    }
+
+    SeriesId id = seriesCount_;
+    Series& series = series_[id];
+    series.device = deviceIt->second;
+    // hashed, so that the shard of a device does not depend on the order
+    // devices were registered in
+    series.shard = fnv1a(device.data(), device.size()) % shards_.size();
+    series.deviceId = device;
+    series.measurement = measurement;
+    series.type = type;
+    seriesIndex_[path] = id;
+    __atomic_store_n(&seriesCount_, id + 1, __ATOMIC_RELEASE);
+    return id;
+}
+
+IngestPoint* IngestionService::newPoint(SeriesId series, TSDataType type,
+                                       int64_t timestamp) {
+    if (series >= __atomic_load_n(&seriesCount_, __ATOMIC_ACQUIRE) ||
+        series_[series].type != type) {
+        return NULL;
+    }
+    IngestPoint* point = shards_[series_[series].shard]->pool.allocate();
+    point->series = series;
+    point->timestamp = timestamp;
+    point->text = NULL;
+    return point;
+}
+
+void IngestionService::enqueue(IngestPoint* point) {
+    Shard& shard = *shards_[series_[point->series].shard];
+    shard.queue.push(point);
+    // pairs with the fence of an idle sender: either it sees the point, or
+    // we see it idle and wake it up
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shard.idle, __ATOMIC_RELAXED)) {
+        MutexLock lock(shard.mutex);
+        shard.wakeup.signal();
+    }
+}
+
+bool IngestionService::writeBoolean(SeriesId series, int64_t timestamp,
+                                    bool value) {
+    IngestPoint* point = newPoint(series, BOOLEAN, timestamp);
+    if (!point) return false;
+    point->boolValue = value;
+    enqueue(point);
+    return true;
+}
+
+bool IngestionService::writeInt32(SeriesId series, int64_t timestamp,
+                                  int32_t value) {
+    IngestPoint* point = newPoint(series, INT32, timestamp);
+    if (!point) return false;
+    point->intValue = value;
+    enqueue(point);
+    return true;
+}
+
+bool IngestionService::writeInt64(SeriesId series, int64_t timestamp,
+                                  int64_t value) {
+    IngestPoint* point = newPoint(series, INT64, timestamp);
+    if (!point) return false;
+    point->longValue = value;
+    enqueue(point);
+    return true;
+}
+
+bool IngestionService::writeFloat(SeriesId series, int64_t timestamp,
+                                  float value) {
+    IngestPoint* point = newPoint(series, FLOAT, timestamp);
+    if (!point) return false;
+    point->floatValue = value;
+    enqueue(point);
+    return true;
+}
+
+bool IngestionService::writeDouble(SeriesId series, int64_t timestamp,
+                                   double value) {
+    IngestPoint* point = newPoint(series, DOUBLE, timestamp);
+    if (!point) return false;
+    point->doubleValue = value;
+    enqueue(point);
+    return true;
+}
+
+bool IngestionService::writeText(SeriesId series, int64_t timestamp,
+                                 const std::string& value) {
+    IngestPoint* point = newPoint(series, TEXT, timestamp);
+    if (!point) return false;
+    point->textLength = value.size();
+    if (value.size() <= INGEST_INLINE_TEXT) {
+        memcpy(point->inlineText, value.data(), value.size());
+    } else {
+        point->text = new std::string(value);
+    }
+    enqueue(point);
+    return true;
+}
+
+void IngestionService::append(Shard& shard, IngestPoint* point) {
+    const Series& series = series_[point->series];
+    DeviceBuilder*& builder = shard.builders[series.device];
+    if (!builder) {
+        builder = new DeviceBuilder();
+        builder->tablet = NULL;
+        builder->firstRowAt = 0;
+    }
+
+    std::map<SeriesId, size_t>::iterator column =
+        builder->columns.find(point->series);
+    if (column == builder->columns.end()) {
+        // a new measurement changes the tablet shape, send what we have and
+        // keep the wider schema for the following tablets of this device
+        flushDevice(shard, *builder);
+        delete builder->tablet;
+        builder->tablet = NULL;
+        column = builder->columns
+                     .insert(std::make_pair(point->series,
+                                            builder->schemas.size()))
+                     .first;
+        builder->schemas.push_back(
+            std::make_pair(series.measurement, series.type));
+    }
+    if (!builder->tablet) {
+        builder->tablet = new Tablet(series.deviceId, builder->schemas,
+                                     options_.maxRows, options_.isAligned);
+        builder->tablet->setTimestampCompression(options_.compressTimestamps);
+    }
+
+    Tablet& tablet = *builder->tablet;
+    if (tablet.rowSize == 0 ||
+        tablet.getTimestamp(tablet.rowSize - 1) != point->timestamp) {
+        size_t rowLimit = tablet.maxRowNumber;
+        if (options_.batchController &&
+            options_.batchController->targetRows() < rowLimit) {
+            rowLimit = options_.batchController->targetRows();
+        }
+        if (tablet.rowSize >= rowLimit ||
+            (tablet.rowSize != 0 &&
+             tablet.getValueByteSize() >= options_.maxBytes)) {
+            flushDevice(shard, *builder);
+        }
+        if (tablet.rowSize == 0) {
+            builder->firstRowAt = monotonicMicros();
+        }
+        tablet.appendTimestamp(point->timestamp);
+    }
+
+    size_t row = tablet.rowSize - 1;
+    if (series.type == TEXT) {
+        tablet.addText(column->second, row,
+                       point->text ? point->text->data() : point->inlineText,
+                       point->textLength);
+    } else {
+        tablet.addValue(column->second, row, &point->boolValue);
+    }
+    tablet.bitMaps[column->second].mark(row);
+    __atomic_fetch_add(&shard.stats.points, 1, __ATOMIC_RELAXED);
+}
+
+void IngestionService::flushDevice(Shard& shard, DeviceBuilder& builder) {
+    if (!builder.tablet || builder.tablet->rowSize == 0) {
+        return;
+    }
+    if (options_.pointFilter) {
+        options_.pointFilter->apply(*builder.tablet);
+        if (builder.tablet->rowSize == 0) {
+            builder.tablet->reset();
+            return;
+        }
+    }
+    __atomic_fetch_add(&shard.stats.tablets, 1, __ATOMIC_RELAXED);
+    uint64_t sentAt = monotonicMicros();
+    if (Tracer::isEnabled()) {
+        Tracer::record("tablet.build", builder.firstRowAt,
+                       sentAt - builder.firstRowAt, "device",
+                       builder.tablet->deviceId, builder.tablet->rowSize, -1);
+    }
+    bool ok = shard.client->insertTablet(*builder.tablet);
+    if (options_.batchController) {
+        options_.batchController->onRequest(
+            builder.tablet->rowSize, monotonicMicros() - sentAt, ok);
+    }
+    if (!ok) {
+        uint64_t rejected = 0;
+        for (size_t i = 0; i < builder.schemas.size(); i++) {
+            for (size_t row = 0; row < builder.tablet->rowSize; row++) {
+                if (builder.tablet->bitMaps[i].isMarked(row)) {
+                    rejected++;
+                }
+            }
+        }
+        __atomic_fetch_add(&shard.stats.failedTablets, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard.stats.rejected, rejected, __ATOMIC_RELAXED);
+        if (options_.pointFilter) {
+            // the kept points the filter compares with never arrived
+            options_.pointFilter->resetDevice(builder.tablet->deviceId);
+        }
+    }
+    builder.tablet->reset();
+}
+
+void IngestionService::flushExpired(Shard& shard, bool all) {
+    uint64_t now = monotonicMicros();
+    std::map<size_t, DeviceBuilder*>::iterator it;
+    for (it = shard.builders.begin(); it != shard.builders.end(); ++it) {
+        DeviceBuilder& builder = *it->second;
+        if (builder.tablet && builder.tablet->rowSize != 0 &&
+            (all || now - builder.firstRowAt >= options_.maxAgeMs * 1000)) {
+            flushDevice(shard, builder);
+        }
+    }
+}
+
+uint64_t IngestionService::idleMillis(const Shard& shard) const {
+    uint64_t now = monotonicMicros();
+    uint64_t wait = (uint64_t)-1;
+    std::map<size_t, DeviceBuilder*>::const_iterator it;
+    for (it = shard.builders.begin(); it != shard.builders.end(); ++it) {
+        const DeviceBuilder& builder = *it->second;
+        if (!builder.tablet || builder.tablet->rowSize == 0) {
+            continue;
+        }
+        uint64_t deadline = builder.firstRowAt + options_.maxAgeMs * 1000;
+        uint64_t millis = deadline > now ? (deadline - now + 999) / 1000 : 1;
+        if (millis < wait) wait = millis;
+    }
+    return wait;
+}
+
+void* IngestionService::runShard(void* arg) {
+    Shard& shard = *(Shard*)arg;
+    IngestionService& service = *shard.service;
+    uint64_t lastAgeCheck = monotonicMicros();
+    while (true) {
+        bool stopping = !__atomic_load_n(&service.running_, __ATOMIC_ACQUIRE);
+        size_t drained = 0;
+        IngestPoint* point;
+        while ((point = shard.queue.pop()) != NULL) {
+            service.append(shard, point);
+            delete point->text;
+            shard.pool.release(point);
+            drained++;
+        }
+        if (stopping) {
+            // producers must have returned before close(), so an empty
+            // queue here means every point was appended
+            service.flushExpired(shard, true);
+            break;
+        }
+        uint64_t now = monotonicMicros();
+        if (now - lastAgeCheck >= 1000) {
+            service.flushExpired(shard, false);
+            lastAgeCheck = now;
+        }
+        if (drained != 0) {
+            continue;
+        }
+
+        // block until a producer pushes, close() is called or the oldest
+        // pending row is due; the queue is checked again with `idle` set so
+        // that a point pushed meanwhile is not left waiting
+        uint64_t wait = service.idleMillis(shard);
+        shard.mutex.lock();
+        __atomic_store_n(&shard.idle, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        point = shard.queue.pop();
+        if (!point && __atomic_load_n(&service.running_, __ATOMIC_ACQUIRE)) {
+            if (wait == (uint64_t)-1) {
+                shard.wakeup.wait(shard.mutex);
+            } else {
+                shard.wakeup.waitFor(shard.mutex, wait);
+            }
+        }
+        __atomic_store_n(&shard.idle, false, __ATOMIC_RELAXED);
+        shard.mutex.unlock();
+        if (point) {
+            service.append(shard, point);
+            delete point->text;
+            shard.pool.release(point);
+        }
+    }
+
+    std::map<size_t, DeviceBuilder*>::iterator it;
+    for (it = shard.builders.begin(); it != shard.builders.end(); ++it) {
+        delete it->second->tablet;
+        delete it->second;
+    }
+    shard.builders.clear();
+    return NULL;
+}
+
+IngestionService::Stats IngestionService::getStats() const {
+    Stats total;
+    total.points = 0;
+    total.rejected = 0;
+    total.tablets = 0;
+    total.failedTablets = 0;
+    for (size_t i = 0; i < shards_.size(); i++) {
+        const Stats& stats = shards_[i]->stats;
+        total.points += __atomic_load_n(&stats.points, __ATOMIC_RELAXED);
+        total.rejected += __atomic_load_n(&stats.rejected, __ATOMIC_RELAXED);
+        total.tablets += __atomic_load_n(&stats.tablets, __ATOMIC_RELAXED);
+        total.failedTablets +=
+            __atomic_load_n(&stats.failedTablets, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/** ------ end ingestion service defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,174 @@
+#ifndef INGESTION_SERVICE_H
+#define INGESTION_SERVICE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "adaptive_batch.h"
+#include "concurrency.h"
+#include "point_filter.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ ingestion service ------ */
+struct IngestionOptions {
+    size_t maxRows;     // flush a device tablet once it holds this many rows
+    size_t maxBytes;    // ... or once getValueByteSize() reaches this
+    uint64_t maxAgeMs;  // ... or once its first row waited this long
+    size_t maxSeries;   // capacity of the series registry
+    size_t queuedPoints;  // preallocated queue nodes per sender thread, more
+                          // points in flight are allocated one by one
+    bool isAligned;
+    bool compressTimestamps;  // Tablet::setTimestampCompression() of tablets
+    // when set, flush at its current setpoint instead of maxRows, which
+    // stays the upper bound; owned by the caller
+    AdaptiveBatchController *batchController;
+    // when set, drop points with it before a tablet is sent, and reset the
+    // device in it when the tablet fails; owned by the caller and shared by
+    // all sender threads
+    PointFilter *pointFilter;
+
+    IngestionOptions()
+        : maxRows(1024),
+          maxBytes(4 << 20),
+          maxAgeMs(1000),
+          maxSeries(1 << 16),
+          queuedPoints(1 << 14),
+          isAligned(false),
+          compressTimestamps(false),
+          batchController(NULL),
+          pointFilter(NULL) {}
+};
+
+// TEXT values up to this size are stored in the queue node itself
+static const size_t INGEST_INLINE_TEXT = 32;
+
+struct IngestPoint {
+    IngestPoint *next;
+    size_t series;
+    int64_t timestamp;
+    union {
+        bool boolValue;
+        int32_t intValue;
+        int64_t longValue;
+        float floatValue;
+        double doubleValue;
+        size_t textLength;
+    };
+    std::string *text;  // a longer TEXT value, NULL if inline
+    char inlineText[INGEST_INLINE_TEXT];
+};
+
+/**
+ * Thread safe write front end for many producer threads.
+ *
+ * Devices are sharded over the given clients, one sender thread per client.
+ * Producers push points into the lock free queue of the device's shard and
+ * return immediately; each sender thread drains its queue into one Tablet
+ * per device and sends a tablet with insertTablet once it reaches maxRows,
+ * maxBytes or maxAgeMs. Points of one device with equal timestamps that
+ * arrive back to back share a tablet row.
+ *
+ * Register every series once and write through the returned id; the
+ * (device, measurement) lookup takes a lock and is meant for setup only.
+ */
+class IngestionService {
+   public:
+    typedef size_t SeriesId;
+    static const SeriesId INVALID_SERIES = (SeriesId)-1;
+
+    struct Stats {
+        uint64_t points;         // points appended to tablets
+        uint64_t rejected;       // points dropped with a failed tablet
+        uint64_t tablets;        // tablets sent
+        uint64_t failedTablets;  // tablets the server rejected
+    };
+
+    IngestionService(const std::vector<RestClient *> &clients,
+                     const IngestionOptions &options);
+    ~IngestionService();  // flushes everything written before
+
+    // return the id of the series, INVALID_SERIES once maxSeries is reached
+    // or if the series was registered with another type
+    SeriesId registerSeries(const std::string &device,
+                            const std::string &measurement, TSDataType type);
+
+    // return false if `series` is unknown or of another data type
+    bool writeBoolean(SeriesId series, int64_t timestamp, bool value);
+    bool writeInt32(SeriesId series, int64_t timestamp, int32_t value);
+    bool writeInt64(SeriesId series, int64_t timestamp, int64_t value);
+    bool writeFloat(SeriesId series, int64_t timestamp, float value);
+    bool writeDouble(SeriesId series, int64_t timestamp, double value);
+    bool writeText(SeriesId series, int64_t timestamp,
+                   const std::string &value);
+
+    // send everything written before the call, then stop the sender threads
+    void close();
+
+    Stats getStats() const;
+
+   private:
+    // immutable once published through seriesCount_
+    struct Series {
+        size_t device;
+        size_t shard;
+        std::string deviceId;
+        std::string measurement;
+        TSDataType type;
+    };
+
+    struct DeviceBuilder {
+        Tablet *tablet;
+        std::map<SeriesId, size_t> columns;  // series -> schema index
+        std::vector<std::pair<std::string, TSDataType> > schemas;
+        uint64_t firstRowAt;
+    };
+
+    struct Shard {
+        IngestionService *service;
+        RestClient *client;
+        MpscQueue<IngestPoint> queue;
+        NodePool<IngestPoint> pool;  // nodes of `queue`
+        std::map<size_t, DeviceBuilder *> builders;
+        pthread_t thread;
+        // an idle sender waits on `wakeup` with `idle` set, producers only
+        // take `mutex` to signal it when they see the flag
+        Mutex mutex;
+        Condition wakeup;
+        bool idle;
+        Stats stats;
+
+        explicit Shard(size_t queuedPoints) : pool(queuedPoints), idle(false) {}
+    };
+
+    static void *runShard(void *arg);
+    // return a node for a point of `series`, NULL if the series is unknown
+    // or of another data type
+    IngestPoint *newPoint(SeriesId series, TSDataType type,
+                          int64_t timestamp);
+    void enqueue(IngestPoint *point);
+    void append(Shard &shard, IngestPoint *point);
+    void flushDevice(Shard &shard, DeviceBuilder &builder);
+    void flushExpired(Shard &shard, bool all);
+    // milliseconds until the oldest pending row of `shard` reaches maxAgeMs
+    uint64_t idleMillis(const Shard &shard) const;
+
+    IngestionService(const IngestionService &);
+    IngestionService &operator=(const IngestionService &);
+
+    IngestionOptions options_;
+    std::vector<Shard *> shards_;
+    std::vector<Series> series_;  // sized maxSeries, published by seriesCount_
+    size_t seriesCount_;
+    std::map<std::string, SeriesId> seriesIndex_;
+    std::map<std::string, size_t> deviceIndex_;
+    Mutex registryMutex_;
+    bool running_;
+};
+
+/** ------ end ingestion service ------ */
+
+}  // namespace rest_client
+#endif  // INGESTION_SERVICE_H
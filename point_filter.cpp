@@ -0,0 +1,287 @@
+#include "point_filter.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace rest_client {
+
+/** ------ point filter defination ------ */
+PointFilter::PointFilter(const PointFilterOptions& defaults)
+    : defaults_(defaults) {
+    stats_.pointsIn = 0;
+    stats_.pointsOut = 0;
+}
+
+PointFilter::~PointFilter() {
+    std::map<std::string, DeviceState*>::iterator it;
+    for (it = devices_.begin(); it != devices_.end(); ++it) {
+        delete it->second;
+    }
+}
+
+PointFilter::DeviceState& PointFilter::deviceState(const std::string& device) {
+    MutexLock lock(mutex_);
+    DeviceState*& state = devices_[device];
+    if (!state) {
+        state = new DeviceState();
+    }
+    return *state;
+}
+
+void PointFilter::setSeriesOptions(const std::string& device,
+                                   const std::string& measurement,
+                                   const PointFilterOptions& options) {
+    DeviceState& entry = deviceState(device);
+    MutexLock lock(entry.mutex);
+    SeriesState& state = entry.series[measurement];
+    state = SeriesState();
+    state.configured = true;
+    state.options = options;
+}
+
+void PointFilter::resetSeries(std::map<std::string, SeriesState>& series) {
+    std::map<std::string, SeriesState>::iterator it;
+    for (it = series.begin(); it != series.end(); ++it) {
+        SeriesState reset;
+        reset.configured = it->second.configured;
+        reset.options = it->second.options;
+        it->second = reset;
+    }
+}
+
+void PointFilter::resetState() {
+    MutexLock lock(mutex_);
+    std::map<std::string, DeviceState*>::iterator it;
+    for (it = devices_.begin(); it != devices_.end(); ++it) {
+        MutexLock deviceLock(it->second->mutex);
+        resetSeries(it->second->series);
+    }
+}
+
+void PointFilter::resetDevice(const std::string& device) {
+    DeviceState& state = deviceState(device);
+    MutexLock lock(state.mutex);
+    resetSeries(state.series);
+}
+
+PointFilter::Stats PointFilter::getStats() {
+    Stats stats;
+    stats.pointsIn = __atomic_load_n(&stats_.pointsIn, __ATOMIC_RELAXED);
+    stats.pointsOut = __atomic_load_n(&stats_.pointsOut, __ATOMIC_RELAXED);
+    return stats;
+}
+
+size_t PointFilter::apply(Tablet& tablet) {
+    DeviceState& device = deviceState(tablet.deviceId);
+    MutexLock lock(device.mutex);
+    size_t dropped = 0;
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        SeriesState& state = device.series[tablet.schemas[i].first];
+        if (!state.configured) {
+            state.options = defaults_;
+        }
+        if (state.options.mode == FILTER_NONE) {
+            continue;
+        }
+        if (state.options.mode == FILTER_SWINGING_DOOR &&
+            tablet.schemas[i].second != BOOLEAN &&
+            tablet.schemas[i].second != TEXT) {
+            dropped += filterSwingingDoor(tablet, i, state);
+        } else {
+            dropped += filterColumn(tablet, i, state);
+        }
+    }
+    if (dropped != 0) {
+        tablet.removeUnmarkedRows();
+    }
+    return dropped;
+}
+
+static double cellValue(const Tablet& tablet, size_t schemaId, size_t row) {
+    switch (tablet.schemas[schemaId].second) {
+        case BOOLEAN:
+            return ((bool*)tablet.values[schemaId])[row] ? 1 : 0;
+        case INT32:
+            return ((int*)tablet.values[schemaId])[row];
+        case INT64:
+            return (double)((int64_t*)tablet.values[schemaId])[row];
+        case FLOAT:
+            return ((float*)tablet.values[schemaId])[row];
+        case DOUBLE:
+            return ((double*)tablet.values[schemaId])[row];
+        default:
+            return 0;
+    }
+}
+
+// exact value of BOOLEAN, INT32 and INT64 cells, which a double may round
+static int64_t cellInteger(const Tablet& tablet, size_t schemaId,
+                           size_t row) {
+    switch (tablet.schemas[schemaId].second) {
+        case BOOLEAN:
+            return ((bool*)tablet.values[schemaId])[row] ? 1 : 0;
+        case INT32:
+            return ((int*)tablet.values[schemaId])[row];
+        case INT64:
+            return ((int64_t*)tablet.values[schemaId])[row];
+        default:
+            return 0;
+    }
+}
+
+// the point at `timestamp` must be kept whatever its value
+static bool forcedPoint(bool hasLast, int64_t lastTimestamp,
+                        int64_t timestamp, int64_t maxGap) {
+    return !hasLast || timestamp <= lastTimestamp ||
+           (maxGap > 0 &&
+            (uint64_t)timestamp - (uint64_t)lastTimestamp >= (uint64_t)maxGap);
+}
+
+size_t PointFilter::filterColumn(Tablet& tablet, size_t schemaId,
+                                 SeriesState& state) {
+    TSDataType type = tablet.schemas[schemaId].second;
+    PointFilterMode mode = state.options.mode;
+    if (type == BOOLEAN || type == TEXT) {
+        mode = FILTER_EXACT_CHANGE;
+    }
+    bool integer = type == BOOLEAN || type == INT32 || type == INT64;
+    BitMap& marks = tablet.bitMaps[schemaId];
+    size_t seen = 0;
+    size_t kept = 0;
+    for (size_t row = 0; row < tablet.rowSize; row++) {
+        if (!marks.isMarked(row)) {
+            continue;
+        }
+        seen++;
+        int64_t timestamp = tablet.getTimestamp(row);
+        double value = cellValue(tablet, schemaId, row);
+        bool keep = forcedPoint(state.hasLast, state.lastTimestamp, timestamp,
+                                state.options.maxGap);
+        if (!keep) {
+            switch (mode) {
+                case FILTER_EXACT_CHANGE:
+                    if (type == TEXT) {
+                        const TextRef& text = tablet.getText(schemaId, row);
+                        keep = text.length != state.lastText.size() ||
+                               memcmp(text.data, state.lastText.data(),
+                                      text.length) != 0;
+                    } else if (integer) {
+                        keep = cellInteger(tablet, schemaId, row) !=
+                               state.lastInteger;
+                    } else {
+                        keep = value != state.lastValue;
+                    }
+                    break;
+                case FILTER_ABSOLUTE_DEADBAND:
+                    keep = fabs(value - state.lastValue) >
+                           state.options.tolerance;
+                    break;
+                case FILTER_RELATIVE_DEADBAND:
+                    keep = fabs(value - state.lastValue) >
+                           state.options.tolerance * fabs(state.lastValue);
+                    break;
+                default:
+                    keep = true;
+            }
+        }
+        if (!keep) {
+            marks.unmark(row);
+            continue;
+        }
+        kept++;
+        state.hasLast = true;
+        state.lastTimestamp = timestamp;
+        state.lastValue = value;
+        if (type == TEXT) {
+            state.lastText = tablet.getText(schemaId, row).str();
+        } else if (integer) {
+            state.lastInteger = cellInteger(tablet, schemaId, row);
+        }
+    }
+    __atomic_fetch_add(&stats_.pointsIn, seen, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_.pointsOut, kept, __ATOMIC_RELAXED);
+    return seen - kept;
+}
+
+size_t PointFilter::filterSwingingDoor(Tablet& tablet, size_t schemaId,
+                                       SeriesState& state) {
+    BitMap& marks = tablet.bitMaps[schemaId];
+    double tolerance = state.options.tolerance;
+    size_t seen = 0;
+    size_t kept = 0;
+    for (size_t row = 0; row < tablet.rowSize; row++) {
+        if (!marks.isMarked(row)) {
+            continue;
+        }
+        seen++;
+        int64_t timestamp = tablet.getTimestamp(row);
+        double value = cellValue(tablet, schemaId, row);
+        if (!forcedPoint(state.hasLast, state.lastTimestamp, timestamp,
+                         state.options.maxGap)) {
+            double elapsed = (double)(timestamp - state.lastTimestamp);
+            double slope = (value - state.lastValue) / elapsed;
+            double lower = slope - tolerance / elapsed;
+            double upper = slope + tolerance / elapsed;
+            if (!state.hasHeld ||
+                (slope >= state.lowerSlope && slope <= state.upperSlope)) {
+                // a line to the point passes all held back points within
+                // tolerance: narrow the door and hold the point back
+                if (state.hasHeld) {
+                    if (state.lowerSlope > lower) lower = state.lowerSlope;
+                    if (state.upperSlope < upper) upper = state.upperSlope;
+                }
+                state.lowerSlope = lower;
+                state.upperSlope = upper;
+                state.hasHeld = true;
+                state.heldRow = row;
+                state.heldTimestamp = timestamp;
+                state.heldValue = value;
+                marks.unmark(row);
+                continue;
+            }
+            // the door closed: the held point is a corner, and the next
+            // door opens from it
+            marks.mark(state.heldRow);
+            kept++;
+            state.lastTimestamp = state.heldTimestamp;
+            state.lastValue = state.heldValue;
+            state.hasHeld = false;
+            if (timestamp > state.lastTimestamp) {
+                elapsed = (double)(timestamp - state.lastTimestamp);
+                state.lowerSlope =
+                    (value - tolerance - state.lastValue) / elapsed;
+                state.upperSlope =
+                    (value + tolerance - state.lastValue) / elapsed;
+                state.hasHeld = true;
+                state.heldRow = row;
+                state.heldTimestamp = timestamp;
+                state.heldValue = value;
+                marks.unmark(row);
+                continue;
+            }
+        } else if (state.hasHeld) {
+            marks.mark(state.heldRow);
+            kept++;
+            state.hasHeld = false;
+        }
+        kept++;
+        state.hasLast = true;
+        state.lastTimestamp = timestamp;
+        state.lastValue = value;
+    }
+    // later points are not known yet, so the last one must be sent now
+    if (state.hasHeld) {
+        marks.mark(state.heldRow);
+        kept++;
+        state.lastTimestamp = state.heldTimestamp;
+        state.lastValue = state.heldValue;
+        state.hasHeld = false;
+    }
+    __atomic_fetch_add(&stats_.pointsIn, seen, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_.pointsOut, kept, __ATOMIC_RELAXED);
+    return seen - kept;
+}
+
+/** ------ end point filter defination ------ */
+
+}  // namespace rest_client
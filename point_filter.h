@@ -0,0 +1,142 @@
+#ifndef POINT_FILTER_H
+#define POINT_FILTER_H
+
+#include <map>
+#include <string>
+
+#include "concurrency.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ point filter ------ */
+enum PointFilterMode {
+    FILTER_NONE,               // keep every point
+    FILTER_EXACT_CHANGE,       // drop points equal to the last kept one
+    FILTER_ABSOLUTE_DEADBAND,  // ... within tolerance of the last kept one
+    FILTER_RELATIVE_DEADBAND,  // ... within tolerance * |last kept value|
+    FILTER_SWINGING_DOOR       // keep the corners of a piecewise linear fit
+};
+
+struct PointFilterOptions {
+    PointFilterMode mode;
+    double tolerance;  // deviation a dropped point may have
+    int64_t maxGap;    // keep a point this long after the last kept one as
+                       // heartbeat, in timestamp units; 0 never forces one
+
+    PointFilterOptions() : mode(FILTER_NONE), tolerance(0), maxGap(0) {}
+    PointFilterOptions(PointFilterMode mode, double tolerance,
+                       int64_t maxGap = 0)
+        : mode(mode), tolerance(tolerance), maxGap(maxGap) {}
+};
+
+/**
+ * Client side counterpart of the SDT compressor of the server: drops the
+ * points of flat or slowly drifting series before they are sent, instead
+ * of after. Every series keeps its filter state across tablets, so the
+ * same filter must see all tablets of a series in time order.
+ *
+ * Swinging door keeps a point only when the next one no longer fits a line
+ * from the last kept point within `tolerance`, so reading the kept points
+ * with linear interpolation stays within `tolerance` of every dropped one.
+ * The last point of a series in a tablet is always kept, the tablet must
+ * not depend on points that are only known later. BOOLEAN and TEXT series
+ * only support exact change, which all modes but FILTER_NONE fall back to.
+ *
+ * Thread safe, so one filter may serve all sender threads of a writer;
+ * every device has its own lock, so tablets of different devices are
+ * filtered in parallel.
+ */
+class PointFilter {
+   public:
+    struct Stats {
+        uint64_t pointsIn;   // marked cells of filtered series seen
+        uint64_t pointsOut;  // ... of them that were kept
+
+        // pointsIn / pointsOut, 1 before any point was dropped
+        double compressionRatio() const {
+            return pointsOut == 0 ? 1.0 : (double)pointsIn / pointsOut;
+        }
+    };
+
+    explicit PointFilter(
+        const PointFilterOptions &defaults = PointFilterOptions());
+    ~PointFilter();
+
+    // filter the series with `options` instead of the defaults
+    void setSeriesOptions(const std::string &device,
+                          const std::string &measurement,
+                          const PointFilterOptions &options);
+    // forget the last kept point of every series, e.g. after a failed send
+    void resetState();
+    // ... of the series of one device
+    void resetDevice(const std::string &device);
+
+    /**
+     * Unmark the cells of `tablet` the filters drop and remove the rows left
+     * without marked cells. Rows must be in timestamp order; a point that is
+     * not newer than the last kept one of its series is kept. Returns the
+     * number of dropped cells.
+     */
+    size_t apply(Tablet &tablet);
+
+    Stats getStats();
+
+   private:
+    struct SeriesState {
+        bool configured;  // options were set with setSeriesOptions()
+        PointFilterOptions options;
+        bool hasLast;
+        int64_t lastTimestamp;  // of the last kept point
+        double lastValue;
+        int64_t lastInteger;  // exact value of integer series
+        std::string lastText;
+        // swinging door: slopes of the door from the last kept point, and
+        // the newest point that still fits, held back until it is known
+        // whether it is a corner
+        double lowerSlope;
+        double upperSlope;
+        bool hasHeld;
+        size_t heldRow;
+        int64_t heldTimestamp;
+        double heldValue;
+
+        SeriesState()
+            : configured(false),
+              hasLast(false),
+              lastTimestamp(0),
+              lastValue(0),
+              lastInteger(0),
+              lowerSlope(0),
+              upperSlope(0),
+              hasHeld(false),
+              heldRow(0),
+              heldTimestamp(0),
+              heldValue(0) {}
+    };
+
+    struct DeviceState {
+        Mutex mutex;  // guards series
+        std::map<std::string, SeriesState> series;  // by measurement
+    };
+
+    PointFilter(const PointFilter &);
+    PointFilter &operator=(const PointFilter &);
+
+    // the state of `device`, created on first use
+    DeviceState &deviceState(const std::string &device);
+    static void resetSeries(std::map<std::string, SeriesState> &series);
+    size_t filterColumn(Tablet &tablet, size_t schemaId, SeriesState &state);
+    size_t filterSwingingDoor(Tablet &tablet, size_t schemaId,
+                              SeriesState &state);
+
+    PointFilterOptions defaults_;
+    Mutex mutex_;  // guards devices_, not the states in it
+    std::map<std::string, DeviceState *> devices_;
+    Stats stats_;  // updated atomically
+};
+
+/** ------ end point filter ------ */
+
+}  // namespace rest_client
+#endif  // POINT_FILTER_H
@@ -0,0 +1,235 @@
+#include "query_cache.h"
+
+#include <ctype.h>
+
+namespace rest_client {
+
+/** ------ query result cache defination ------ */
+QueryResultCache::QueryResultCache(size_t maxBytes, uint64_t ttlMs)
+    : maxBytes_(maxBytes), ttlMicros_(ttlMs * 1000) {
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.evictions = 0;
+    stats_.deduplicated = 0;
+    stats_.entries = 0;
+    stats_.bytes = 0;
+}
+
+QueryResultCache::~QueryResultCache() {
+    // owners still fetching must not outlive the cache, so only the
+    // bookkeeping of finished fetches can be left here
+    std::map<std::string, InFlight*>::iterator it;
+    for (it = inFlight_.begin(); it != inFlight_.end(); ++it) {
+        if (it->second->result) {
+            release(it->second->result);
+        }
+        delete it->second;
+    }
+    clear();
+}
+
+std::string QueryResultCache::normalize(const std::string& sql) {
+    std::string result;
+    result.reserve(sql.size());
+    char quote = 0;
+    bool pendingSpace = false;
+    for (size_t i = 0; i < sql.size(); i++) {
+        char c = sql[i];
+        if (quote == 0 && isspace((unsigned char)c)) {
+            pendingSpace = !result.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            result += ' ';
+            pendingSpace = false;
+        }
+        if (quote == 0 && (c == '\'' || c == '"' || c == '`')) {
+            quote = c;
+        } else if (c == quote) {
+            quote = 0;
+        }
+        result += c;
+    }
+    while (!result.empty() && result[result.size() - 1] == ';') {
+        result.erase(result.size() - 1);
+    }
+    return result;
+}
+
+bool QueryResultCache::acquire(const std::string& key, Json::Value& value) {
+    SharedResult* result = acquireShared(key);
+    if (!result) {
+        return false;
+    }
+    value = result->value;
+    release(result);
+    return true;
+}
+
+QueryResultCache::SharedResult* QueryResultCache::acquireShared(
+    const std::string& key) {
+    MutexLock lock(mutex_);
+    while (true) {
+        std::map<std::string, Entry>::iterator it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (ttlMicros_ == 0 ||
+                monotonicMicros() - it->second.fetchedAt <= ttlMicros_) {
+                lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+                stats_.hits++;
+                SharedResult* result = it->second.result;
+                __atomic_add_fetch(&result->references, 1, __ATOMIC_RELAXED);
+                return result;
+            }
+            eraseLocked(it);
+        }
+
+        std::map<std::string, InFlight*>::iterator pending =
+            inFlight_.find(key);
+        if (pending == inFlight_.end()) {
+            InFlight* fetch = new InFlight();
+            fetch->done = false;
+            fetch->result = NULL;
+            fetch->waiters = 0;
+            inFlight_[key] = fetch;
+            stats_.misses++;
+            return NULL;
+        }
+
+        InFlight* fetch = pending->second;
+        fetch->waiters++;
+        while (!fetch->done && inFlight_.count(key) &&
+               inFlight_[key] == fetch) {
+            fetched_.wait(mutex_);
+        }
+        fetch->waiters--;
+        if (fetch->done) {
+            SharedResult* result = fetch->result;
+            __atomic_add_fetch(&result->references, 1, __ATOMIC_RELAXED);
+            stats_.deduplicated++;
+            if (fetch->waiters == 0) {
+                release(fetch->result);
+                delete fetch;
+            }
+            return result;
+        }
+        // the owner abandoned the fetch, compete to become the next owner
+        if (fetch->waiters == 0) {
+            delete fetch;
+        }
+    }
+}
+
+void QueryResultCache::release(SharedResult* result) {
+    if (__atomic_sub_fetch(&result->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        delete result;
+    }
+}
+
+void QueryResultCache::complete(const std::string& key,
+                                const Json::Value& value) {
+    // copy and measure the result before taking the lock
+    SharedResult* result = new SharedResult();
+    result->value = value;
+    result->references = 1;
+    size_t bytes = key.size() + estimateJsonBytes(value);
+
+    MutexLock lock(mutex_);
+    std::map<std::string, InFlight*>::iterator pending = inFlight_.find(key);
+    if (pending != inFlight_.end()) {
+        InFlight* fetch = pending->second;
+        inFlight_.erase(pending);
+        if (fetch->waiters == 0) {
+            delete fetch;
+        } else {
+            __atomic_add_fetch(&result->references, 1, __ATOMIC_RELAXED);
+            fetch->result = result;
+            fetch->done = true;
+            fetched_.broadcast();
+        }
+    }
+
+    if (bytes > maxBytes_) {
+        release(result);
+        return;
+    }
+    std::map<std::string, Entry>::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+        eraseLocked(it);
+    }
+    it = entries_.insert(std::make_pair(key, Entry())).first;
+    it->second.result = result;
+    it->second.bytes = bytes;
+    it->second.fetchedAt = monotonicMicros();
+    lru_.push_front(&it->first);
+    it->second.lruPos = lru_.begin();
+    stats_.bytes += bytes;
+
+    while (stats_.bytes > maxBytes_) {
+        eraseLocked(entries_.find(*lru_.back()));
+        stats_.evictions++;
+    }
+}
+
+void QueryResultCache::abandon(const std::string& key) {
+    MutexLock lock(mutex_);
+    std::map<std::string, InFlight*>::iterator pending = inFlight_.find(key);
+    if (pending != inFlight_.end()) {
+        InFlight* fetch = pending->second;
+        inFlight_.erase(pending);
+        if (fetch->waiters == 0) {
+            delete fetch;
+        } else {
+            fetched_.broadcast();
+        }
+    }
+}
+
+void QueryResultCache::eraseLocked(std::map<std::string, Entry>::iterator it) {
+    stats_.bytes -= it->second.bytes;
+    lru_.erase(it->second.lruPos);
+    release(it->second.result);
+    entries_.erase(it);
+}
+
+void QueryResultCache::clear() {
+    MutexLock lock(mutex_);
+    while (!entries_.empty()) {
+        eraseLocked(entries_.begin());
+    }
+}
+
+QueryResultCache::Stats QueryResultCache::getStats() {
+    MutexLock lock(mutex_);
+    Stats stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+}
+
+size_t estimateJsonBytes(const Json::Value& value) {
+    size_t bytes = sizeof(Json::Value);
+    switch (value.type()) {
+        case Json::stringValue:
+            bytes += value.asString().size();
+            break;
+        case Json::arrayValue:
+            for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+                bytes += estimateJsonBytes(value[i]);
+            }
+            break;
+        case Json::objectValue: {
+            Json::Value::Members members = value.getMemberNames();
+            for (size_t i = 0; i < members.size(); i++) {
+                bytes += members[i].size() +
+                         estimateJsonBytes(value[members[i]]);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return bytes;
+}
+
+/** ------ end query result cache defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,108 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "concurrency.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ query result cache ------ */
+/**
+ * Decoded responses of read only queries keyed by normalized SQL, shared by
+ * any number of RestClient instances and threads. RestClient adds its server
+ * and user name to the key, so clients of different servers or users do not
+ * see each other's results.
+ *
+ * The cache holds at most `maxBytes` of estimated result size, evicting the
+ * least recently used entries first, and serves an entry for at most `ttlMs`
+ * milliseconds after it was fetched (0 keeps entries until evicted). A query
+ * that is already being fetched by another thread is not sent twice: later
+ * callers wait for the first one and share its result.
+ *
+ * Writes do not invalidate anything: a query answered from the cache does
+ * not see points written after it was fetched until the entry expires or
+ * clear() is called, so pick `ttlMs` by how stale a result may be.
+ *
+ * Results are stored once and shared by reference count, copying a result
+ * into the caller's Json::Value happens outside of the cache lock.
+ */
+class QueryResultCache {
+   public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t deduplicated;  // misses served by another thread's request
+        size_t entries;
+        size_t bytes;
+    };
+
+    QueryResultCache(size_t maxBytes, uint64_t ttlMs);
+    ~QueryResultCache();
+
+    // collapse whitespace outside of quotes and drop a trailing ';'
+    static std::string normalize(const std::string &sql);
+
+    /**
+     * Return true and fill `value` if `key` is cached or was fetched by a
+     * concurrent caller meanwhile. Otherwise the caller becomes the owner of
+     * the fetch and must report it with complete() or abandon().
+     */
+    bool acquire(const std::string &key, Json::Value &value);
+    void complete(const std::string &key, const Json::Value &value);
+    // the owner failed; one of the waiting callers takes over the fetch
+    void abandon(const std::string &key);
+
+    void clear();
+    Stats getStats();
+
+   private:
+    // an immutable result shared by the cache and the callers copying it
+    struct SharedResult {
+        Json::Value value;
+        int references;
+    };
+
+    struct Entry {
+        SharedResult *result;
+        size_t bytes;
+        uint64_t fetchedAt;
+        std::list<const std::string *>::iterator lruPos;
+    };
+
+    struct InFlight {
+        bool done;
+        SharedResult *result;
+        int waiters;
+    };
+
+    // the cached or fetched result of `key` with a reference for the
+    // caller, NULL if the caller became the owner of the fetch
+    SharedResult *acquireShared(const std::string &key);
+    static void release(SharedResult *result);
+    void eraseLocked(std::map<std::string, Entry>::iterator it);
+
+    QueryResultCache(const QueryResultCache &);
+    QueryResultCache &operator=(const QueryResultCache &);
+
+    size_t maxBytes_;
+    uint64_t ttlMicros_;
+    Mutex mutex_;
+    Condition fetched_;
+    std::map<std::string, Entry> entries_;
+    std::list<const std::string *> lru_;  // keys of entries_, most recent first
+    std::map<std::string, InFlight *> inFlight_;
+    Stats stats_;
+};
+
+// rough heap footprint of a decoded json document
+size_t estimateJsonBytes(const Json::Value &value);
+
+/** ------ end query result cache ------ */
+
+}  // namespace rest_client
+#endif  // QUERY_CACHE_H
@@ -1,9 +1,152 @@
 #include "rest_client.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
 #include <sstream>
 
+#include "device_query.h"
+#include "query_cache.h"
+#include "segmented_result.h"
+#include "trace.h"
+
 namespace rest_client {
 
+/** ------ json text writer defination ------ */
+void appendJsonString(std::string& out, const char* data, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(data + start, i - start);
+        start = i + 1;
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+        }
+    }
+    out.append(data + start, length - start);
+    out += '"';
+}
+
+void appendJsonInt64(std::string& out, int64_t value) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--p = '-';
+    out.append(p, end - p);
+}
+
+// keep integral reals recognizable as reals, like Json::Value does
+static void appendJsonReal(std::string& out, const char* text, int length) {
+    out.append(text, length);
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '.' || text[i] == 'e') return;
+    }
+    out += ".0";
+}
+
+void appendJsonFloat(std::string& out, float value) {
+    if (isnan(value) || isinf(value)) {
+        out += "null";
+        return;
+    }
+    char buf[32];
+    int length = snprintf(buf, sizeof(buf), "%.9g", value);
+    appendJsonReal(out, buf, length);
+}
+
+void appendJsonDouble(std::string& out, double value) {
+    if (isnan(value) || isinf(value)) {
+        out += "null";
+        return;
+    }
+    char buf[32];
+    int length = snprintf(buf, sizeof(buf), "%.17g", value);
+    appendJsonReal(out, buf, length);
+}
+
+/** ------ end json text writer defination ------ */
+
+/** ------ string arena defination ------ */
+const uint32_t TextRef::NO_CODE;
+const size_t StringArena::BLOCK_BYTES;
+
+StringArena::~StringArena() {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        delete[] blocks_[i];
+    }
+}
+
+const char* StringArena::copy(const char* data, size_t length) {
+    if (length == 0) {
+        return "";
+    }
+    if (length > BLOCK_BYTES / 4) {
+        // large values get a block of their own, inserted before the current
+        // block so that its free space stays usable
+        if (blocks_.empty()) {
+            blocks_.push_back(new char[BLOCK_BYTES]);
+            used_ = 0;
+        }
+        char* block = new char[length];
+        memcpy(block, data, length);
+        blocks_.insert(blocks_.end() - 1, block);
+        return block;
+    }
+    if (blocks_.empty() || used_ + length > BLOCK_BYTES) {
+        blocks_.push_back(new char[BLOCK_BYTES]);
+        used_ = 0;
+    }
+    char* p = blocks_.back() + used_;
+    memcpy(p, data, length);
+    used_ += length;
+    return p;
+}
+
+void StringArena::clear() {
+    if (blocks_.empty()) {
+        return;
+    }
+    // the last block is always a regular one
+    char* keep = blocks_.back();
+    for (size_t i = 0; i + 1 < blocks_.size(); i++) {
+        delete[] blocks_[i];
+    }
+    blocks_.assign(1, keep);
+    used_ = 0;
+}
+
+/** ------ end string arena defination ------ */
+
 /** ------ Tablet defination ------ */
 void Tablet::createColumns() {
     for (size_t i = 0; i < schemas.size(); i++) {
@@ -25,7 +168,7 @@ void Tablet::createColumns() {
                 values[i] = new double[maxRowNumber];
                 break;
             case TEXT:
-                values[i] = new std::string[maxRowNumber];
+                values[i] = new TextRef[maxRowNumber];
                 break;
         }
     }
@@ -61,7 +204,7 @@ void Tablet::deleteColumns() {
                 break;
             }
             case TEXT: {
-                std::string* valueBuf = (std::string*)(values[i]);
+                TextRef* valueBuf = (TextRef*)(values[i]);
                 delete[] valueBuf;
                 break;
             }
@@ -118,9 +261,8 @@ bool Tablet::addValue(size_t schemaId, size_t rowIndex, void* value) {
             break;
         }
         case TEXT: {
-            std::string* valueBuf = (std::string*)(values[schemaId]);
-            valueBuf[rowIndex] = *(std::string*)value;
-            break;
+            const std::string* text = (const std::string*)value;
+            return addText(schemaId, rowIndex, text->data(), text->size());
         }
         default:
             std::cout << "addValue() default" << std::endl;
@@ -128,12 +270,99 @@ bool Tablet::addValue(size_t schemaId, size_t rowIndex, void* value) {
     return true;
 }
 
+bool Tablet::addText(size_t schemaId, size_t rowIndex, const char* data,
+                     size_t length) {
+    if (schemaId >= schemas.size() || schemas[schemaId].second != TEXT ||
+        rowIndex >= rowSize) {
+        std::cout << "Tablet::addText(), no TEXT cell at schemaId=" << schemaId
+                  << ", rowIndex=" << rowIndex << "." << std::endl;
+        return false;
+    }
+    TextRef& cell = ((TextRef*)values[schemaId])[rowIndex];
+    textBytes_ += length - cell.length;
+    const TextRef* entry = findDictionaryText(data, length);
+    if (entry) {
+        cell = *entry;
+        return true;
+    }
+    cell.data = textArena_.copy(data, length);
+    cell.length = (uint32_t)length;
+    cell.code = TextRef::NO_CODE;
+    return true;
+}
+
+void Tablet::setTextDictionary(size_t maxEntries) {
+    maxDictionaryEntries_ = maxEntries;
+    size_t slots = 0;
+    if (maxEntries != 0) {
+        // at most half full, so that probe sequences stay short
+        slots = 1;
+        while (slots < maxEntries * 2) slots <<= 1;
+    }
+    // the entries stay in the arena, so cells that refer to one only lose
+    // the code of its escaped form
+    for (size_t i = 0; i < schemas.size() && !dictionary_.empty(); i++) {
+        if (schemas[i].second != TEXT) {
+            continue;
+        }
+        TextRef* cells = (TextRef*)values[i];
+        for (size_t row = 0; row < rowSize; row++) {
+            cells[row].code = TextRef::NO_CODE;
+        }
+    }
+    dictionarySlots_.assign(slots, 0);
+    dictionary_.clear();
+    dictionaryJson_.clear();
+}
+
+const TextRef* Tablet::findDictionaryText(const char* data, size_t length) {
+    if (dictionarySlots_.empty()) {
+        return NULL;
+    }
+    uint32_t hash = fnv1a(data, length);
+    size_t mask = dictionarySlots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t code = dictionarySlots_[slot];
+        if (code == 0) {
+            if (dictionary_.size() >= maxDictionaryEntries_) {
+                return NULL;
+            }
+            TextRef entry;
+            entry.data = textArena_.copy(data, length);
+            entry.length = (uint32_t)length;
+            entry.code = (uint32_t)dictionary_.size();
+            dictionary_.push_back(entry);
+            dictionaryJson_.push_back(std::string());
+            appendJsonString(dictionaryJson_.back(), data, length);
+            dictionarySlots_[slot] = entry.code + 1;
+            return &dictionary_.back();
+        }
+        const TextRef& entry = dictionary_[code - 1];
+        if (entry.length == length && memcmp(entry.data, data, length) == 0) {
+            return &entry;
+        }
+    }
+}
+
+void Tablet::clearText() {
+    textArena_.clear();
+    textBytes_ = 0;
+    if (!dictionary_.empty()) {
+        dictionary_.clear();
+        dictionaryJson_.clear();
+        std::fill(dictionarySlots_.begin(), dictionarySlots_.end(), 0);
+    }
+}
+
 Json::Value Tablet::toJson() const {
+    TraceSpan span("tablet.toJson");
+    span.setDevice(deviceId);
+    span.setRows(rowSize);
     Json::Value value;
     value["device"] = deviceId;
     value["is_aligned"] = isAligned;
     for (size_t i = 0; i < rowSize; i++) {
-        value["timestamps"].append(timestamps[i]);
+        value["timestamps"].append(getTimestamp(i));
         for (int ts_ind = 0; ts_ind < values.size(); ts_ind++) {
             if (bitMaps[ts_ind].isMarked(i)) {
                 switch (schemas[ts_ind].second) {
@@ -163,8 +392,9 @@ Json::Value Tablet::toJson() const {
                         break;
                     }
                     case TEXT: {
-                        std::string* valueBuf = (std::string*)(values[ts_ind]);
-                        value["values"][ts_ind].append(valueBuf[i]);
+                        const TextRef& text = getText(ts_ind, i);
+                        value["values"][ts_ind].append(
+                            Json::Value(text.data, text.data + text.length));
                         break;
                     }
                     default:
@@ -182,8 +412,643 @@ Json::Value Tablet::toJson() const {
     return value;
 }
 
+void Tablet::setTimestampCompression(bool enable) {
+    compressTimestamps_ = enable;
+    if (enable) {
+        std::vector<int64_t>().swap(timestamps);
+    }
+    reset();
+}
+
+void Tablet::appendTimestampRun(int64_t timestamp) {
+    if (!timestampRuns_.empty()) {
+        TimestampRun& run = timestampRuns_.back();
+        // unsigned arithmetic, timestamps far apart must not overflow
+        uint64_t rows = rowSize - run.firstRow;
+        uint64_t delta = (uint64_t)timestamp - (uint64_t)run.start;
+        if (rows == 1) {
+            run.interval = (int64_t)delta;
+            rowSize++;
+            return;
+        }
+        if (delta == rows * (uint64_t)run.interval) {
+            rowSize++;
+            return;
+        }
+        // a run costs three words, give up once they average fewer rows
+        if (timestampRuns_.size() >= MIN_TIMESTAMP_RUNS &&
+            timestampRuns_.size() * 3 > rowSize) {
+            expandTimestampRuns();
+            timestamps[rowSize++] = timestamp;
+            return;
+        }
+    }
+    TimestampRun run;
+    run.firstRow = rowSize;
+    run.start = timestamp;
+    run.interval = 0;
+    timestampRuns_.push_back(run);
+    rowSize++;
+}
+
+int64_t Tablet::getRunTimestamp(size_t row) const {
+    // rows are mostly read in order, so try the last run before searching
+    size_t run = timestampRuns_.size() - 1;
+    if (row < timestampRuns_[run].firstRow) {
+        size_t low = 0;
+        while (low < run) {
+            size_t middle = low + (run - low + 1) / 2;
+            if (timestampRuns_[middle].firstRow <= row) {
+                low = middle;
+            } else {
+                run = middle - 1;
+            }
+        }
+    }
+    const TimestampRun& found = timestampRuns_[run];
+    return (int64_t)((uint64_t)found.start +
+                     (uint64_t)(row - found.firstRow) *
+                         (uint64_t)found.interval);
+}
+
+void Tablet::expandTimestampRuns() {
+    timestamps.resize(maxRowNumber);
+    for (size_t row = 0; row < rowSize; row++) {
+        timestamps[row] = getRunTimestamp(row);
+    }
+    timestampRuns_.clear();
+    timestampsAreRuns_ = false;
+}
+
+size_t Tablet::removeUnmarkedRows() {
+    size_t kept = 0;
+    for (size_t row = 0; row < rowSize; row++) {
+        bool marked = false;
+        for (size_t i = 0; i < schemas.size() && !marked; i++) {
+            marked = bitMaps[i].isMarked(row);
+        }
+        if (!marked) {
+            continue;
+        }
+        if (kept != row) {
+            if (timestampsAreRuns_) {
+                // rows keep their timestamps only as plain values
+                expandTimestampRuns();
+            }
+            timestamps[kept] = timestamps[row];
+            for (size_t i = 0; i < schemas.size(); i++) {
+                size_t width = DatatypeFixedWidth(schemas[i].second);
+                char* column = (char*)values[i];
+                if (width != 0) {
+                    memcpy(column + kept * width, column + row * width, width);
+                } else {
+                    ((TextRef*)column)[kept] = ((TextRef*)column)[row];
+                }
+                if (bitMaps[i].isMarked(row)) {
+                    bitMaps[i].mark(kept);
+                } else {
+                    bitMaps[i].unmark(kept);
+                }
+            }
+        }
+        kept++;
+    }
+    for (size_t row = kept; row < rowSize; row++) {
+        for (size_t i = 0; i < schemas.size(); i++) {
+            bitMaps[i].unmark(row);
+        }
+    }
+    size_t removed = rowSize - kept;
+    rowSize = kept;
+    if (removed != 0) {
+        recountTextBytes(kept + removed);
+    }
+    return removed;
+}
+
+void Tablet::recountTextBytes(size_t oldRowSize) {
+    textBytes_ = 0;
+    for (size_t i = 0; i < schemas.size(); i++) {
+        if (schemas[i].second != TEXT) {
+            continue;
+        }
+        TextRef* cells = (TextRef*)values[i];
+        for (size_t row = 0; row < rowSize; row++) {
+            textBytes_ += cells[row].length;
+        }
+        std::fill(cells + rowSize, cells + oldRowSize, TextRef());
+    }
+}
+
+bool Tablet::isSortedByTime(bool strict) const {
+    for (size_t row = 1; row < rowSize; row++) {
+        int64_t previous = getTimestamp(row - 1);
+        int64_t timestamp = getTimestamp(row);
+        if (timestamp < previous || (strict && timestamp == previous)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Tablet::sortByTime(bool dedup) {
+    if (isSortedByTime(dedup)) {
+        return 0;
+    }
+    return gatherSortedRows(*this, dedup);
+}
+
+size_t Tablet::assignSortedByTime(const Tablet& source, bool dedup) {
+    if (&source == this) {
+        return sortByTime(dedup);
+    }
+    return gatherSortedRows(source, dedup);
+}
+
+// row of a tablet with its timestamp as offset from the smallest one
+struct SortKey {
+    uint64_t key;
+    size_t row;
+};
+
+static inline uint64_t sortKeyOf(const SortKey& item) { return item.key; }
+// offset in the high half and row in the low half, half the bytes to move
+static inline uint64_t sortKeyOf(uint64_t item) { return item >> 32; }
+
+// stable LSD radix sort by keys in [0, range], one pass per byte of the
+// range that is not the same in all keys
+template <typename T>
+static void radixSortByKey(std::vector<T>& items, uint64_t range) {
+    size_t n = items.size();
+    size_t bytes = 0;
+    while (bytes < 8 && (range >> (bytes * 8)) != 0) {
+        bytes++;
+    }
+    if (n < 2 || bytes == 0) {
+        return;
+    }
+    std::vector<size_t> counts(bytes * 256, 0);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = sortKeyOf(items[i]);
+        for (size_t byte = 0; byte < bytes; byte++) {
+            counts[byte * 256 + ((key >> (byte * 8)) & 0xff)]++;
+        }
+    }
+    std::vector<T> sorted(n);
+    for (size_t byte = 0; byte < bytes; byte++) {
+        size_t shift = byte * 8;
+        size_t* count = &counts[byte * 256];
+        if (count[(sortKeyOf(items[0]) >> shift) & 0xff] == n) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t digit = 0; digit < 256; digit++) {
+            size_t digitCount = count[digit];
+            count[digit] = offset;
+            offset += digitCount;
+        }
+        for (size_t i = 0; i < n; i++) {
+            sorted[count[(sortKeyOf(items[i]) >> shift) & 0xff]++] = items[i];
+        }
+        items.swap(sorted);
+    }
+}
+
+size_t Tablet::gatherSortedRows(const Tablet& source, bool dedup) {
+    size_t n = source.rowSize;
+    int64_t min = n == 0 ? 0 : source.getTimestamp(0);
+    int64_t max = min;
+    for (size_t row = 1; row < n; row++) {
+        int64_t timestamp = source.getTimestamp(row);
+        if (timestamp < min) min = timestamp;
+        if (timestamp > max) max = timestamp;
+    }
+    // unsigned offsets from the minimum order like the signed timestamps
+    uint64_t range = (uint64_t)max - (uint64_t)min;
+    std::vector<SortKey> keys(n);
+    if ((range >> 32) == 0 && ((uint64_t)n >> 32) == 0) {
+        std::vector<uint64_t> packed(n);
+        for (size_t row = 0; row < n; row++) {
+            uint64_t offset = (uint64_t)source.getTimestamp(row) - (uint64_t)min;
+            packed[row] = offset << 32 | row;
+        }
+        radixSortByKey(packed, range);
+        for (size_t i = 0; i < n; i++) {
+            keys[i].key = packed[i] >> 32;
+            keys[i].row = (size_t)(packed[i] & 0xffffffffu);
+        }
+    } else {
+        for (size_t row = 0; row < n; row++) {
+            keys[row].key = (uint64_t)source.getTimestamp(row) - (uint64_t)min;
+            keys[row].row = row;
+        }
+        radixSortByKey(keys, range);
+    }
+    // every output row is a group of sorted keys ending before ends[row];
+    // without dedup all groups are single rows
+    std::vector<size_t> ends;
+    for (size_t i = 0; i < n; i++) {
+        if (!dedup || i + 1 == n || keys[i + 1].key != keys[i].key) {
+            ends.push_back(i + 1);
+        }
+    }
+    size_t rows = ends.size();
+
+    if (&source != this) {
+        if (schemas == source.schemas && maxRowNumber >= n) {
+            // the shape of the last source, keep the columns
+            deviceId = source.deviceId;
+            reset();
+        } else {
+            init(source.deviceId, source.schemas, n);
+        }
+        isAligned = source.isAligned;
+    }
+    if (timestampsAreRuns_) {
+        expandTimestampRuns();
+    }
+    for (size_t row = 0; row < rows; row++) {
+        timestamps[row] = (int64_t)(keys[ends[row] - 1].key + (uint64_t)min);
+    }
+    rowSize = rows;
+
+    // gather one column at a time into a buffer, so that every column is
+    // written sequentially; a merged cell takes the last row marking it
+    std::vector<char> buffer;
+    BitMap marks(maxRowNumber);
+    for (size_t i = 0; i < schemas.size(); i++) {
+        size_t width = DatatypeFixedWidth(schemas[i].second);
+        bool text = width == 0;
+        if (text) width = sizeof(TextRef);
+        const char* from = (const char*)source.values[i];
+        const BitMap& sourceMarks = source.bitMaps[i];
+        buffer.resize(rows * width);
+        marks.reset();
+        size_t begin = 0;
+        for (size_t row = 0; row < rows; row++) {
+            size_t end = ends[row];
+            size_t picked = keys[end - 1].row;
+            for (size_t k = end; k > begin; k--) {
+                if (sourceMarks.isMarked(keys[k - 1].row)) {
+                    picked = keys[k - 1].row;
+                    marks.mark(row);
+                    break;
+                }
+            }
+            switch (width) {
+                // constant sizes let the compiler inline the copy
+                case 1:
+                    buffer[row] = from[picked];
+                    break;
+                case 4:
+                    memcpy(&buffer[row * 4], from + picked * 4, 4);
+                    break;
+                case 8:
+                    memcpy(&buffer[row * 8], from + picked * 8, 8);
+                    break;
+                default:
+                    memcpy(&buffer[row * width], from + picked * width, width);
+            }
+            begin = end;
+        }
+        if (text && &source != this) {
+            // the refs point into the arena of `source`, copy the text
+            const TextRef* refs = (const TextRef*)&buffer[0];
+            for (size_t row = 0; row < rows; row++) {
+                if (marks.isMarked(row)) {
+                    addText(i, row, refs[row].data, refs[row].length);
+                }
+            }
+        } else if (rows != 0) {
+            memcpy(values[i], &buffer[0], rows * width);
+        }
+        bitMaps[i] = marks;
+    }
+    if (&source == this && rows != n) {
+        // dropped duplicates still hold their text
+        recountTextBytes(n);
+    }
+    return n - rows;
+}
+
+void Tablet::serializeJson(std::string& out) const {
+    TraceSpan span("tablet.serialize");
+    span.setDevice(deviceId);
+    span.setRows(rowSize);
+    size_t begin = out.size();
+    out += "{\"device\":";
+    appendJsonString(out, deviceId.data(), deviceId.size());
+    out += isAligned ? ",\"is_aligned\":true" : ",\"is_aligned\":false";
+    out += ",\"timestamps\":[";
+    if (timestampsAreRuns_) {
+        for (size_t i = 0; i < timestampRuns_.size(); i++) {
+            const TimestampRun& run = timestampRuns_[i];
+            size_t end = i + 1 < timestampRuns_.size()
+                             ? timestampRuns_[i + 1].firstRow
+                             : rowSize;
+            uint64_t timestamp = (uint64_t)run.start;
+            for (size_t row = run.firstRow; row < end; row++) {
+                if (row != 0) out += ',';
+                appendJsonInt64(out, (int64_t)timestamp);
+                timestamp += (uint64_t)run.interval;
+            }
+        }
+    } else {
+        for (size_t row = 0; row < rowSize; row++) {
+            if (row != 0) out += ',';
+            appendJsonInt64(out, timestamps[row]);
+        }
+    }
+    out += "],\"measurements\":[";
+    for (size_t i = 0; i < schemas.size(); i++) {
+        if (i != 0) out += ',';
+        appendJsonString(out, schemas[i].first.data(), schemas[i].first.size());
+    }
+    out += "],\"data_types\":[";
+    for (size_t i = 0; i < schemas.size(); i++) {
+        std::string type = DatatypeToString(schemas[i].second);
+        if (i != 0) out += ',';
+        appendJsonString(out, type.data(), type.size());
+    }
+    out += "],\"values\":[";
+    for (size_t i = 0; i < schemas.size(); i++) {
+        out += i == 0 ? "[" : ",[";
+        for (size_t row = 0; row < rowSize; row++) {
+            if (row != 0) out += ',';
+            appendJsonCell(out, i, row);
+        }
+        out += ']';
+    }
+    out += "]}";
+    span.setBytes(out.size() - begin);
+}
+
+void Tablet::appendJsonCell(std::string& out, size_t schemaId,
+                            size_t row) const {
+    if (!bitMaps[schemaId].isMarked(row)) {
+        out += "null";
+        return;
+    }
+    switch (schemas[schemaId].second) {
+        case BOOLEAN:
+            out += ((bool*)values[schemaId])[row] ? "true" : "false";
+            break;
+        case INT32:
+            appendJsonInt64(out, ((int*)values[schemaId])[row]);
+            break;
+        case INT64:
+            appendJsonInt64(out, ((int64_t*)values[schemaId])[row]);
+            break;
+        case FLOAT:
+            appendJsonFloat(out, ((float*)values[schemaId])[row]);
+            break;
+        case DOUBLE:
+            appendJsonDouble(out, ((double*)values[schemaId])[row]);
+            break;
+        case TEXT: {
+            const TextRef& text = getText(schemaId, row);
+            if (text.code != TextRef::NO_CODE) {
+                out += dictionaryJson_[text.code];
+            } else {
+                appendJsonString(out, text.data, text.length);
+            }
+            break;
+        }
+        default:
+            out += "null";
+    }
+}
+
+void Tablet::serializeJson(std::string& out,
+                           const std::vector<size_t>& columns) const {
+    TraceSpan span("tablet.serialize");
+    span.setDevice(deviceId);
+    size_t begin = out.size();
+    std::vector<size_t> rows;
+    for (size_t row = 0; row < rowSize; row++) {
+        for (size_t i = 0; i < columns.size(); i++) {
+            if (bitMaps[columns[i]].isMarked(row)) {
+                rows.push_back(row);
+                break;
+            }
+        }
+    }
+    span.setRows(rows.size());
+    out += "{\"device\":";
+    appendJsonString(out, deviceId.data(), deviceId.size());
+    out += isAligned ? ",\"is_aligned\":true" : ",\"is_aligned\":false";
+    out += ",\"timestamps\":[";
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (i != 0) out += ',';
+        appendJsonInt64(out, getTimestamp(rows[i]));
+    }
+    out += "],\"measurements\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        const std::string& name = schemas[columns[i]].first;
+        if (i != 0) out += ',';
+        appendJsonString(out, name.data(), name.size());
+    }
+    out += "],\"data_types\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        std::string type = DatatypeToString(schemas[columns[i]].second);
+        if (i != 0) out += ',';
+        appendJsonString(out, type.data(), type.size());
+    }
+    out += "],\"values\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        out += i == 0 ? "[" : ",[";
+        for (size_t j = 0; j < rows.size(); j++) {
+            if (j != 0) out += ',';
+            appendJsonCell(out, columns[i], rows[j]);
+        }
+        out += ']';
+    }
+    out += "]}";
+    span.setBytes(out.size() - begin);
+}
+
+void Tablet::serializeRecordsJson(std::string& out) const {
+    TraceSpan span("tablet.serializeRecords");
+    span.setDevice(deviceId);
+    size_t begin = out.size();
+    std::string device;
+    appendJsonString(device, deviceId.data(), deviceId.size());
+    std::vector<std::string> names(schemas.size());
+    std::vector<std::string> types(schemas.size());
+    for (size_t i = 0; i < schemas.size(); i++) {
+        std::string type = DatatypeToString(schemas[i].second);
+        appendJsonString(names[i], schemas[i].first.data(),
+                         schemas[i].first.size());
+        appendJsonString(types[i], type.data(), type.size());
+    }
+    // the five lists are written in one pass each over the marked rows
+    std::vector<size_t> rows;
+    for (size_t row = 0; row < rowSize; row++) {
+        for (size_t i = 0; i < schemas.size(); i++) {
+            if (bitMaps[i].isMarked(row)) {
+                rows.push_back(row);
+                break;
+            }
+        }
+    }
+    span.setRows(rows.size());
+    out += isAligned ? "{\"is_aligned\":true" : "{\"is_aligned\":false";
+    out += ",\"devices\":[";
+    for (size_t j = 0; j < rows.size(); j++) {
+        if (j != 0) out += ',';
+        out += device;
+    }
+    out += "],\"timestamps\":[";
+    for (size_t j = 0; j < rows.size(); j++) {
+        if (j != 0) out += ',';
+        appendJsonInt64(out, getTimestamp(rows[j]));
+    }
+    const char* lists[] = {"],\"measurements_list\":[",
+                           "],\"data_types_list\":[", "],\"values_list\":["};
+    for (size_t list = 0; list < 3; list++) {
+        out += lists[list];
+        for (size_t j = 0; j < rows.size(); j++) {
+            out += j == 0 ? "[" : ",[";
+            bool first = true;
+            for (size_t i = 0; i < schemas.size(); i++) {
+                if (!bitMaps[i].isMarked(rows[j])) {
+                    continue;
+                }
+                if (!first) out += ',';
+                first = false;
+                if (list == 0) {
+                    out += names[i];
+                } else if (list == 1) {
+                    out += types[i];
+                } else {
+                    appendJsonCell(out, i, rows[j]);
+                }
+            }
+            out += ']';
+        }
+    }
+    out += "]}";
+    span.setBytes(out.size() - begin);
+}
+
+// rough JSON length of one value, only used to compare the encodings
+static size_t estimateJsonValueBytes(TSDataType type, size_t textBytes) {
+    switch (type) {
+        case BOOLEAN:
+            return 5;
+        case INT32:
+            return 6;
+        case INT64:
+            return 12;
+        case FLOAT:
+            return 9;
+        case DOUBLE:
+            return 17;
+        case TEXT:
+            return textBytes + 2;
+        default:
+            return 4;
+    }
+}
+
+void Tablet::estimateInsert(InsertEstimate& estimate) const {
+    static const size_t TIMESTAMP_BYTES = 14;  // 13 digits and a comma
+    static const size_t NULL_BYTES = 5;        // "null,"
+    estimate.groups.clear();
+    std::vector<size_t> marked(schemas.size());
+    size_t markedCells = 0;
+    size_t textCells = 0;
+    for (size_t i = 0; i < schemas.size(); i++) {
+        marked[i] = bitMaps[i].count(rowSize);
+        markedCells += marked[i];
+        if (schemas[i].second == TEXT) {
+            textCells += marked[i];
+        }
+    }
+    size_t cells = rowSize * schemas.size();
+    estimate.density = cells == 0 ? 1.0 : (double)markedCells / cells;
+    size_t textBytes = textCells == 0 ? 0 : textBytes_ / textCells;
+
+    // rows with any marked cell and columns with equal bitmaps, both from
+    // the bitmap bytes below rowSize
+    size_t bytes = (rowSize + 7) / 8;
+    unsigned char tailMask =
+        rowSize % 8 == 0 ? 0xff : (unsigned char)((1u << (rowSize % 8)) - 1);
+    std::vector<unsigned char> anyMarked(bytes, 0);
+    std::map<std::string, size_t> groupOfBitmap;
+    for (size_t i = 0; i < schemas.size(); i++) {
+        if (marked[i] == 0) {
+            continue;
+        }
+        std::string key(bitMaps[i].getByteArray().begin(),
+                        bitMaps[i].getByteArray().begin() + bytes);
+        if (bytes != 0) key[bytes - 1] &= tailMask;
+        for (size_t j = 0; j < bytes; j++) {
+            anyMarked[j] |= (unsigned char)key[j];
+        }
+        std::map<std::string, size_t>::iterator group =
+            groupOfBitmap.find(key);
+        if (group == groupOfBitmap.end()) {
+            group = groupOfBitmap
+                        .insert(std::make_pair(key, estimate.groups.size()))
+                        .first;
+            estimate.groups.push_back(std::vector<size_t>());
+        }
+        estimate.groups[group->second].push_back(i);
+    }
+    size_t markedRows = 0;
+    for (size_t j = 0; j < bytes; j++) {
+        markedRows += __builtin_popcount(anyMarked[j]);
+    }
+
+    size_t header = InsertEstimate::REQUEST_BYTES + deviceId.size() + 80;
+    estimate.tabletBytes = header + rowSize * TIMESTAMP_BYTES;
+    estimate.recordsBytes =
+        header + markedRows * (deviceId.size() + 3 + TIMESTAMP_BYTES + 9);
+    for (size_t i = 0; i < schemas.size(); i++) {
+        size_t name = schemas[i].first.size() + 3;
+        size_t type = DatatypeToString(schemas[i].second).size() + 3;
+        size_t value =
+            estimateJsonValueBytes(schemas[i].second, textBytes) + 1;
+        estimate.tabletBytes +=
+            name + type + 3 + marked[i] * value +
+            (rowSize - marked[i]) * NULL_BYTES;
+        estimate.recordsBytes += marked[i] * (name + type + value);
+    }
+    estimate.groupsBytes = 0;
+    for (size_t g = 0; g < estimate.groups.size(); g++) {
+        const std::vector<size_t>& group = estimate.groups[g];
+        estimate.groupsBytes += header + marked[group[0]] * TIMESTAMP_BYTES;
+        for (size_t i = 0; i < group.size(); i++) {
+            size_t column = group[i];
+            estimate.groupsBytes +=
+                schemas[column].first.size() +
+                DatatypeToString(schemas[column].second).size() + 9 +
+                marked[column] *
+                    (estimateJsonValueBytes(schemas[column].second,
+                                            textBytes) +
+                     1);
+        }
+    }
+}
+
 void Tablet::reset() {
+    for (size_t i = 0; i < schemas.size(); i++) {
+        if (schemas[i].second == TEXT) {
+            std::fill((TextRef*)values[i], (TextRef*)values[i] + rowSize,
+                      TextRef());
+        }
+    }
+    clearText();
     rowSize = 0;
+    if (compressTimestamps_ && !timestampsAreRuns_) {
+        // keep the capacity in case the next rows are irregular again
+        timestamps.clear();
+    } else if (!compressTimestamps_ && timestampsAreRuns_) {
+        timestamps.resize(maxRowNumber);
+    }
+    timestampRuns_.clear();
+    timestampsAreRuns_ = compressTimestamps_;
     for (size_t i = 0; i < schemas.size(); i++) {
         bitMaps[i].reset();
     }
@@ -210,25 +1075,87 @@ size_t Tablet::getValueByteSize() {
             case DOUBLE:
                 valueOccupation += rowSize * 8;
                 break;
-            case TEXT: {
+            case TEXT:
                 valueOccupation += rowSize * 4;
-                std::string* valueBuf = (std::string*)(values[i]);
-                for (size_t j = 0; j < rowSize; j++) {
-                    valueOccupation += valueBuf[j].size();
-                }
                 break;
-            }
             default:
                 std::cout << "getValueByteSize() default" << std::endl;
         }
     }
-    return valueOccupation;
+    return valueOccupation + textBytes_;
 }
 
 void Tablet::setAligned(bool isAligned) { this->isAligned = isAligned; }
 
 /** ------ end tablet defination ------ */
 
+/** ------ last value cache defination ------ */
+uint64_t monotonicMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void LastValueCache::touch(Entry& entry) {
+    lru_.splice(lru_.begin(), lru_, entry.lruPos);
+}
+
+void LastValueCache::update(const std::string& path, int64_t timestamp,
+                            const Json::Value& value) {
+    std::map<std::string, Entry>::iterator it = entries_.find(path);
+    if (it == entries_.end()) {
+        it = entries_.insert(std::make_pair(path, Entry())).first;
+        lru_.push_front(&it->first);
+        it->second.lruPos = lru_.begin();
+    } else if (it->second.timestamp > timestamp) {
+        return;
+    } else {
+        touch(it->second);
+    }
+    it->second.timestamp = timestamp;
+    it->second.value = value;
+    it->second.updatedAt = monotonicMicros();
+
+    while (entries_.size() > maxEntries_) {
+        entries_.erase(*lru_.back());
+        lru_.pop_back();
+    }
+}
+
+const Json::Value* LastValueCache::lookup(const std::string& path,
+                                          int64_t& timestamp) {
+    std::map<std::string, Entry>::iterator it = entries_.find(path);
+    if (it == entries_.end()) {
+        misses_++;
+        return NULL;
+    }
+    if (ttlMicros_ != 0 &&
+        monotonicMicros() - it->second.updatedAt > ttlMicros_) {
+        erase(path);
+        misses_++;
+        return NULL;
+    }
+    touch(it->second);
+    hits_++;
+    timestamp = it->second.timestamp;
+    return &it->second.value;
+}
+
+void LastValueCache::erase(const std::string& path) {
+    std::map<std::string, Entry>::iterator it = entries_.find(path);
+    if (it != entries_.end()) {
+        lru_.erase(it->second.lruPos);
+        entries_.erase(it);
+    }
+}
+
+void LastValueCache::clear() {
+    entries_.clear();
+    lru_.clear();
+}
+
+/** ------ end last value cache defination ------ */
+
 // curl call back function
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
     ((std::string*)userp)->append((char*)contents, size * nmemb);
@@ -246,6 +1173,57 @@ bool RestClient::pingIoTDB() {
     return false;
 }
 
+void RestClient::enableLastValueCache(size_t maxEntries, uint64_t ttlMs) {
+    delete last_value_cache_;
+    last_value_cache_ = new LastValueCache(maxEntries, ttlMs);
+}
+
+void RestClient::disableLastValueCache() {
+    delete last_value_cache_;
+    last_value_cache_ = NULL;
+}
+
+static Json::Value cellToJson(const Tablet& tablet, size_t schemaId,
+                              size_t row) {
+    switch (tablet.schemas[schemaId].second) {
+        case BOOLEAN:
+            return Json::Value(((bool*)tablet.values[schemaId])[row]);
+        case INT32:
+            return Json::Value(((int*)tablet.values[schemaId])[row]);
+        case INT64:
+            return Json::Value(
+                (Json::Int64)((int64_t*)tablet.values[schemaId])[row]);
+        case FLOAT:
+            return Json::Value(((float*)tablet.values[schemaId])[row]);
+        case DOUBLE:
+            return Json::Value(((double*)tablet.values[schemaId])[row]);
+        case TEXT: {
+            const TextRef& text = tablet.getText(schemaId, row);
+            return Json::Value(text.data, text.data + text.length);
+        }
+        default:
+            return Json::Value();
+    }
+}
+
+void RestClient::updateLastValueCache(const Tablet& tablet) {
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        size_t latest = tablet.rowSize;
+        for (size_t row = 0; row < tablet.rowSize; row++) {
+            if (tablet.bitMaps[i].isMarked(row) &&
+                (latest == tablet.rowSize ||
+                 tablet.getTimestamp(row) >= tablet.getTimestamp(latest))) {
+                latest = row;
+            }
+        }
+        if (latest != tablet.rowSize) {
+            last_value_cache_->update(
+                tablet.deviceId + "." + tablet.schemas[i].first,
+                tablet.getTimestamp(latest), cellToJson(tablet, i, latest));
+        }
+    }
+}
+
 bool RestClient::validatePath(std::string path) {
     if (path.substr(0, root_path.size()) != root_path) {
         std::cout << "path should begin with root: " << path << std::endl;
@@ -341,6 +1319,31 @@ bool RestClient::createDatabase(std::string path) {
     return true;
 }
 
+// split a finished transfer into its network phases, as measured by curl
+static void traceCurlPhases(CURL* curl, uint64_t startMicros) {
+    static const char* const phases[] = {"http.dns", "http.connect",
+                                         "http.tls", "http.setup",
+                                         "http.wait", "http.receive"};
+    static const CURLINFO infos[] = {
+        CURLINFO_NAMELOOKUP_TIME,  CURLINFO_CONNECT_TIME,
+        CURLINFO_APPCONNECT_TIME,  CURLINFO_PRETRANSFER_TIME,
+        CURLINFO_STARTTRANSFER_TIME, CURLINFO_TOTAL_TIME};
+    double previous = 0;
+    for (size_t i = 0; i < sizeof(infos) / sizeof(infos[0]); i++) {
+        double at = 0;
+        curl_easy_getinfo(curl, infos[i], &at);
+        // phases that did not happen, e.g. TLS or a reused connection's
+        // connect, report 0
+        if (at <= previous) {
+            continue;
+        }
+        Tracer::record(phases[i], startMicros + (uint64_t)(previous * 1e6),
+                       (uint64_t)((at - previous) * 1e6), NULL, std::string(),
+                       -1, -1);
+        previous = at;
+    }
+}
+
 bool RestClient::curl_perfrom(std::string api, std::string data,
                               Json::Value& value, bool need_auth_info,
                               bool is_post) {
@@ -348,6 +1351,11 @@ bool RestClient::curl_perfrom(std::string api, std::string data,
     std::string readBuffer;
     if (curl_connection_) {
         curl_easy_reset(curl_connection_);
+        if (context_->share()) {
+            // the reset detached the handle from the shared caches
+            curl_easy_setopt(curl_connection_, CURLOPT_SHARE,
+                             context_->share());
+        }
         curl_easy_setopt(curl_connection_, CURLOPT_URL,
                          (url_base_ + api).c_str());
         if (need_auth_info) {
@@ -364,12 +1372,25 @@ bool RestClient::curl_perfrom(std::string api, std::string data,
         curl_easy_setopt(curl_connection_, CURLOPT_WRITEDATA, &readBuffer);
         // maintain connections to reduce connection latency.
         curl_easy_setopt(curl_connection_, CURLOPT_FORBID_REUSE, 0L);
+        if (timeout_ms_ > 0) {
+            // timeouts must not use signals in multi threaded programs
+            curl_easy_setopt(curl_connection_, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(curl_connection_, CURLOPT_TIMEOUT_MS, timeout_ms_);
+        }
+        TraceSpan span("http.request");
+        span.setLabel("api", api);
         res = curl_easy_perform(curl_connection_);
+        span.setBytes(data.size() + readBuffer.size());
+        if (span.isActive()) {
+            traceCurlPhases(curl_connection_, span.startMicros());
+        }
         if (res != CURLE_OK) {
             std::cout << "failed to perform api" << api
                       << " error: " << curl_easy_strerror(res) << std::endl;
             return false;
         } else {
+            TraceSpan parseSpan("response.parse");
+            parseSpan.setBytes(readBuffer.size());
             Json::Value json_resp;
             Json::CharReaderBuilder builder;
             std::string errs;
@@ -402,6 +1423,26 @@ int RestClient::runNonQuery(std::string sql, std::string& errmesg) {
 }
 
 bool RestClient::runQuery(std::string sql, Json::Value& value) {
+    if (!query_cache_) {
+        return runQueryUncached(sql, value);
+    }
+    // a shared cache must not answer for another server or user
+    std::string key = url_base_ + '\n' + username_ + '\n' +
+                      QueryResultCache::normalize(sql);
+    if (query_cache_->acquire(key, value)) {
+        return true;
+    }
+    bool ok = runQueryUncached(sql, value);
+    // failed queries answer with a status code instead of a result set
+    if (ok && !value.isMember("code")) {
+        query_cache_->complete(key, value);
+    } else {
+        query_cache_->abandon(key);
+    }
+    return ok;
+}
+
+bool RestClient::runQueryUncached(const std::string& sql, Json::Value& value) {
     Json::Value json_data;
     json_data["sql"] = sql;
     Json::StreamWriterBuilder writer;
@@ -413,76 +1454,59 @@ bool RestClient::runQuery(std::string sql, Json::Value& value) {
     return true;
 }
 
-bool RestClient::queryTimeseriesByTime(std::string device_path,
-                                       std::string sensor_name,
-                                       TSDataType data_type, uint64_t begin,
-                                       uint64_t end, Tablet& tablet) {
-    std::ostringstream oss;
-    oss << "select " << sensor_name << " from " << device_path
-        << " where time >=" << begin << " and time <= " << end << std::endl;
-    std::cout << oss.str() << std::endl;
-    Json::Value value;
-    if (!runQuery(oss.str(), value)) {
+bool RestClient::insertTablet(const Tablet& unsorted) {
+    if (!curl_connection_) {
         return false;
     }
-    const Json::Value timestamps = value["timestamps"];
-    int size = timestamps.size();
-    // there only one sensor in the tablet
-    const Json::Value values = value["values"];
-    for (int i = 0; i < size; i++) {
-        int64_t timestampValue = timestamps[i].asInt64();
-        tablet.addValue(0, i, (void*)&timestampValue);
-        if (!values[0][i].isNull()) {
-            tablet.bitMaps[0].mark(i);
-            continue;
+    const Tablet* sending = &unsorted;
+    if (sort_before_insert_ && !unsorted.isSortedByTime(true)) {
+        TraceSpan sortSpan("tablet.sort");
+        sortSpan.setRows(unsorted.rowSize);
+        sorted_.assignSortedByTime(unsorted, true);
+        sending = &sorted_;
+    }
+    const Tablet& tablet = *sending;
+    TraceSpan span("insertTablet");
+    span.setDevice(tablet.deviceId);
+    span.setRows(tablet.rowSize);
+    std::string json_data;
+    InsertEncoding encoding = INSERT_TABLET;
+    InsertEstimate estimate;
+    if (sparse_insert_) {
+        tablet.estimateInsert(estimate);
+        encoding = estimate.cheapest();
+    }
+    if (encoding == INSERT_RECORDS) {
+        span.setLabel("encoding", "records");
+        tablet.serializeRecordsJson(json_data);
+        if (!insertRecordsPayload(json_data)) {
+            return false;
         }
-        switch (data_type) {
-            case BOOLEAN: {
-                bool value = values[0][i].asBool();
-                tablet.addValue(0, i, (void*)&value);
-                break;
-            }
-            case INT32: {
-                int value = values[0][i].asInt();
-                tablet.addValue(0, i, (void*)&value);
-                break;
-            }
-            case INT64: {
-                int64_t value = values[0][i].asInt64();
-                tablet.addValue(0, i, (void*)&value);
-                break;
-            }
-            case FLOAT: {
-                float value = values[0][i].asFloat();
-                tablet.addValue(0, i, (void*)&value);
-                break;
-            }
-            case DOUBLE: {
-                double value = values[0][i].asDouble();
-                tablet.addValue(0, i, (void*)&value);
-                break;
-            }
-            case TEXT: {
-                std::string value = values[0][i].asString();
-                tablet.addValue(0, i, (void*)&value);
-                break;
+    } else if (encoding == INSERT_COLUMN_GROUPS) {
+        span.setLabel("encoding", "column groups");
+        for (size_t i = 0; i < estimate.groups.size(); i++) {
+            json_data.clear();
+            tablet.serializeJson(json_data, estimate.groups[i]);
+            if (!insertTabletPayload(json_data)) {
+                return false;
             }
-            default:
-                std::cout << "queryTimeseriesByTime() default" << std::endl;
+        }
+    } else {
+        tablet.serializeJson(json_data);
+        if (!insertTabletPayload(json_data)) {
+            return false;
         }
     }
-
+    if (last_value_cache_) {
+        updateLastValueCache(tablet);
+    }
     return true;
 }
 
-bool RestClient::insertTablet(const Tablet& tablet) {
-    CURLcode res;
-    std::string readBuffer;
+bool RestClient::insertTabletPayload(const std::string& json_data) {
     int code = -1;
     if (curl_connection_) {
         Json::Value json_resp;
-        Json::StreamWriterBuilder builder;
-        std::string json_data = Json::writeString(builder, tablet.toJson());
         if (curl_perfrom("/rest/v2/insertTablet", json_data, json_resp)) {
             code = json_resp["code"].asInt();
             if (code != 200) {
@@ -498,6 +1522,23 @@ bool RestClient::insertTablet(const Tablet& tablet) {
     return false;
 }
 
+bool RestClient::insertRecordsPayload(const std::string& json_data) {
+    Json::Value json_resp;
+    if (!curl_connection_ ||
+        !curl_perfrom("/rest/v2/insertRecords", json_data, json_resp)) {
+        return false;
+    }
+    int code = json_resp["code"].asInt();
+    if (code != 200) {
+        std::cout << "insert records failed" << std::endl;
+        std::cout << "code is " << code << std::endl;
+        std::cout << "message" << json_resp["message"].asString()
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
 template <>
 std::string RestClient::parseJsonValue<std::string>(const Json::Value& value) {
     return value.asString();
@@ -551,4 +1592,243 @@ float RestClient::parseJsonValue<float>(const Json::Value& value) {
     return value.asFloat();
 }
 
+void RestClient::decodeColumn(const Json::Value& column, size_t first,
+                              size_t schemaId, Tablet& tablet) {
+    TraceSpan span("query.decode");
+    span.setDevice(tablet.deviceId);
+    span.setRows(tablet.rowSize);
+    for (size_t i = 0; i < tablet.rowSize; i++) {
+        const Json::Value& cell = column[(Json::ArrayIndex)(first + i)];
+        if (cell.isNull()) {
+            continue;
+        }
+        switch (tablet.schemas[schemaId].second) {
+            case BOOLEAN: {
+                bool value = parseJsonValue<bool>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            case INT32: {
+                int32_t value = parseJsonValue<int32_t>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            case INT64: {
+                int64_t value = parseJsonValue<int64_t>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            case FLOAT: {
+                float value = parseJsonValue<float>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            case DOUBLE: {
+                double value = parseJsonValue<double>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            case TEXT: {
+                std::string value = parseJsonValue<std::string>(cell);
+                tablet.addValue(schemaId, i, (void*)&value);
+                break;
+            }
+            default:
+                std::cout << "decodeColumn() default" << std::endl;
+                continue;
+        }
+        tablet.bitMaps[schemaId].mark(i);
+    }
+}
+
+bool RestClient::queryAggregation(
+    std::string device_path, std::string measurement_name,
+    TSDataType data_type, const std::vector<AggregationType>& aggregations,
+    uint64_t begin, uint64_t end, uint64_t interval, Tablet& tablet) {
+    if (aggregations.empty() || interval == 0) {
+        std::cout << "queryAggregation() needs at least one aggregation and a "
+                     "positive interval"
+                  << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    std::ostringstream oss;
+    oss << "select ";
+    for (size_t i = 0; i < aggregations.size(); i++) {
+        std::string column = AggregationToString(aggregations[i]) + "(" +
+                             measurement_name + ")";
+        oss << (i == 0 ? "" : ", ") << column;
+        schemas.push_back(std::make_pair(
+            column, AggregationResultType(aggregations[i], data_type)));
+    }
+    oss << " from " << device_path << " group by ([" << begin << ", " << end
+        << "), " << interval << "ms)";
+
+    Json::Value value;
+    if (!runQuery(oss.str(), value)) {
+        return false;
+    }
+    const Json::Value& timestamps = value["timestamps"];
+    const Json::Value& values = value["values"];
+    if (values.size() != aggregations.size()) {
+        std::cout << "queryAggregation() unexpected response: "
+                  << value.toStyledString() << std::endl;
+        return false;
+    }
+
+    tablet.init(device_path, schemas, timestamps.size());
+    for (Json::ArrayIndex i = 0; i < timestamps.size(); i++) {
+        tablet.appendTimestamp(timestamps[i].asInt64());
+    }
+    for (size_t i = 0; i < schemas.size(); i++) {
+        decodeColumn(values[(Json::ArrayIndex)i], 0, i, tablet);
+    }
+    return true;
+}
+
+bool RestClient::queryAlignByDevice(const DeviceQuery& query,
+                                    DeviceTablets& result) {
+    result.clear();
+    Json::Value value;
+    if (!runQuery(query.toSql(), value)) {
+        return false;
+    }
+    if (value.isMember("code")) {
+        std::cout << "queryAlignByDevice() failed: "
+                  << value["message"].asString() << std::endl;
+        return false;
+    }
+    const Json::Value& names = value["column_names"];
+    const Json::Value& timestamps = value["timestamps"];
+    const Json::Value& values = value["values"];
+    std::map<std::string, size_t> columnIndex;
+    for (Json::ArrayIndex i = 0; i < names.size(); i++) {
+        columnIndex[names[i].asString()] = i;
+    }
+    std::map<std::string, size_t>::iterator deviceColumn =
+        columnIndex.find("Device");
+    if (deviceColumn == columnIndex.end()) {
+        std::cout << "queryAlignByDevice() unexpected response: "
+                  << value.toStyledString() << std::endl;
+        return false;
+    }
+
+    // measurements the server did not return, e.g. cut by SLIMIT, are left
+    // out of the tablets
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    std::vector<size_t> columns;
+    for (size_t i = 0; i < query.measurements.size(); i++) {
+        std::map<std::string, size_t>::iterator it =
+            columnIndex.find(query.measurements[i].first);
+        if (it != columnIndex.end()) {
+            schemas.push_back(query.measurements[i]);
+            columns.push_back(it->second);
+        }
+    }
+
+    // the rows of one device are contiguous, every run becomes a tablet
+    const Json::Value& devices = values[(Json::ArrayIndex)deviceColumn->second];
+    size_t rows = timestamps.size();
+    size_t first = 0;
+    while (first < rows) {
+        std::string device = devices[(Json::ArrayIndex)first].asString();
+        size_t last = first + 1;
+        while (last < rows && devices[(Json::ArrayIndex)last] ==
+                                  devices[(Json::ArrayIndex)first]) {
+            last++;
+        }
+        Tablet& tablet = result.add();
+        tablet.init(device, schemas, last - first);
+        for (size_t row = first; row < last; row++) {
+            tablet.appendTimestamp(timestamps[(Json::ArrayIndex)row].asInt64());
+        }
+        for (size_t i = 0; i < schemas.size(); i++) {
+            decodeColumn(values[(Json::ArrayIndex)columns[i]], first, i,
+                         tablet);
+        }
+        first = last;
+    }
+    return true;
+}
+
+bool RestClient::queryTimeseriesByTime(std::string device_path,
+                                       std::string measurement_name,
+                                       TSDataType data_type, uint64_t begin,
+                                       uint64_t end, Tablet& tablet) {
+    SegmentedResult result;
+    if (!queryTimeseriesByTime(device_path, measurement_name, data_type, begin,
+                               end, result)) {
+        return false;
+    }
+    result.consolidate(tablet);
+    return true;
+}
+
+bool RestClient::queryTimeseriesByTime(std::string device_path,
+                                       std::string measurement_name,
+                                       TSDataType data_type, uint64_t begin,
+                                       uint64_t end, SegmentedResult& result) {
+    std::ostringstream oss;
+    oss << "select " << measurement_name << " from " << device_path
+        << " where time >= " << begin << " and time <= " << end;
+    Json::Value value;
+    if (!runQuery(oss.str(), value)) {
+        return false;
+    }
+    const Json::Value& timestamps = value["timestamps"];
+    const Json::Value& values = value["values"];
+    if (values.size() != 1) {
+        std::cout << "queryTimeseriesByTime() unexpected response: "
+                  << value.toStyledString() << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    schemas.push_back(std::make_pair(measurement_name, data_type));
+    result.reset(device_path, schemas);
+    for (Json::ArrayIndex i = 0; i < timestamps.size(); i++) {
+        result.appendRow(timestamps[i].asInt64());
+    }
+    for (size_t c = 0; c < result.chunkCount(); c++) {
+        decodeColumn(values[0], c * result.chunkRows(), 0, result.getChunk(c));
+    }
+    return true;
+}
+
+bool RestClient::queryM4(std::string device_path, std::string measurement_name,
+                         TSDataType data_type, uint64_t begin, uint64_t end,
+                         uint64_t interval, Tablet& tablet) {
+    if (interval == 0) {
+        std::cout << "queryM4() needs a positive interval" << std::endl;
+        return false;
+    }
+    // the points of the extremes come with their own timestamps, which
+    // MIN_VALUE and MAX_VALUE of a group by query do not return
+    std::ostringstream oss;
+    oss << "select M4(" << measurement_name << ", 'timeInterval'='"
+        << interval << "', 'displayWindowBegin'='" << begin
+        << "', 'displayWindowEnd'='" << end << "') from " << device_path;
+    Json::Value value;
+    if (!runQuery(oss.str(), value)) {
+        return false;
+    }
+    const Json::Value& timestamps = value["timestamps"];
+    const Json::Value& values = value["values"];
+    if (values.size() != 1) {
+        std::cout << "queryM4() unexpected response: "
+                  << value.toStyledString() << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    schemas.push_back(std::make_pair(measurement_name, data_type));
+    tablet.init(device_path, schemas, timestamps.size());
+    for (Json::ArrayIndex i = 0; i < timestamps.size(); i++) {
+        tablet.appendTimestamp(timestamps[i].asInt64());
+    }
+    decodeColumn(values[0], 0, 0, tablet);
+    return true;
+}
+
 }  // namespace rest_client
@@ -5,10 +5,15 @@
 #include <json/json.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <map>
 #include <sstream>
 #include <vector>
 
+#include "client_context.h"
+
 #if defined(_MSC_VER) && (_MSC_VER <= 1500)
 typedef __int64 int64_t;
 typedef __int32 int32_t;
@@ -73,6 +78,29 @@ inline std::string base64_encode(unsigned char const *bytes_to_encode,
 
 /** ------- end encoding base64 ------ */
 
+/** ------- json text writer ------ */
+// Append json literals straight to a request body, for payloads too large to
+// be built as Json::Value trees first. Non finite numbers are written as null.
+void appendJsonString(std::string &out, const char *data, size_t length);
+void appendJsonInt64(std::string &out, int64_t value);
+void appendJsonFloat(std::string &out, float value);
+void appendJsonDouble(std::string &out, double value);
+
+/** ------- end json text writer ------ */
+
+/** ------- string hash ------ */
+// 32 bit FNV-1a, stable across processes and platforms, so it may decide
+// where a device goes
+inline uint32_t fnv1a(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/** ------- end string hash ------ */
+
 /** ------- schema defination and tostring func ------ */
 enum TSDataType {
 #define TS_DATATYPE_ENUM(name) name,
@@ -92,6 +120,12 @@ enum CompressionType {
 #undef TS_COMPRESSION_ENUM
 };
 
+enum AggregationType {
+#define TS_AGGREGATION_ENUM(name) name,
+#include "schema_enum.def"
+#undef TS_AGGREGATION_ENUM
+};
+
 inline std::string DatatypeToString(TSDataType type) {
     switch (type) {
 #define TS_DATATYPE_ENUM(name) \
@@ -103,6 +137,18 @@ inline std::string DatatypeToString(TSDataType type) {
     return "UNKNOWN";
 }
 
+// parse a data type name as printed by DatatypeToString
+inline bool StringToDatatype(const std::string &name, TSDataType &type) {
+#define TS_DATATYPE_ENUM(value) \
+    if (name == #value) {       \
+        type = value;           \
+        return true;            \
+    }
+#include "schema_enum.def"
+#undef TS_DATATYPE_ENUM
+    return false;
+}
+
 inline std::string EncodingToString(TSEncoding encoding) {
     switch (encoding) {
 #define TS_ENCODING_ENUM(name) \
@@ -125,6 +171,52 @@ inline std::string CompressionToString(CompressionType compression) {
     return "UNKNOWN";
 }
 
+inline std::string AggregationToString(AggregationType aggregation) {
+    switch (aggregation) {
+#define TS_AGGREGATION_ENUM(name) \
+    case name:                    \
+        return #name;
+#include "schema_enum.def"
+#undef TS_AGGREGATION_ENUM
+    }
+    return "UNKNOWN";
+}
+
+// bytes of one value in a Tablet column, 0 for TEXT
+inline size_t DatatypeFixedWidth(TSDataType type) {
+    switch (type) {
+        case BOOLEAN:
+            return sizeof(bool);
+        case INT32:
+            return sizeof(int);
+        case INT64:
+            return sizeof(int64_t);
+        case FLOAT:
+            return sizeof(float);
+        case DOUBLE:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+// data type of the column produced by applying `aggregation` to a timeseries
+// of type `type`
+inline TSDataType AggregationResultType(AggregationType aggregation,
+                                        TSDataType type) {
+    switch (aggregation) {
+        case COUNT:
+        case MAX_TIME:
+        case MIN_TIME:
+            return INT64;
+        case AVG:
+        case SUM:
+            return DOUBLE;
+        default:
+            return type;
+    }
+}
+
 /** ------- end schema defination and tostring func ------ */
 
 /** ------- Bit map in Tablet ------ */
@@ -194,6 +286,20 @@ class BitMap {
         return true;
     }
 
+    // number of marked positions before `end`
+    size_t count(size_t end) const {
+        if (end > size) end = size;
+        size_t marked = 0;
+        for (size_t j = 0; j < end >> 3; j++) {
+            marked += __builtin_popcount((unsigned char)bits[j]);
+        }
+        if (end % 8 != 0) {
+            unsigned char tail = bits[end >> 3] & ((1u << (end % 8)) - 1);
+            marked += __builtin_popcount(tail);
+        }
+        return marked;
+    }
+
     const std::vector<char> &getByteArray() const { return this->bits; }
 
     size_t getSize() const { return this->size; }
@@ -205,21 +311,114 @@ class BitMap {
 
 /** ------- end Bit map in Tablet ------ */
 
+/** ------- insert encodings of a Tablet ------ */
+enum InsertEncoding {
+    INSERT_TABLET,         // one insertTablet, unmarked cells sent as null
+    INSERT_RECORDS,        // one insertRecords listing only marked cells
+    INSERT_COLUMN_GROUPS   // one insertTablet per group of equal bitmaps
+};
+
+// Estimated request bytes of a tablet in each encoding, see estimateInsert()
+struct InsertEstimate {
+    // every request costs this much on top of its body: headers, a round
+    // trip and a server side parse, so many small groups are not free
+    static const size_t REQUEST_BYTES = 512;
+
+    double density;       // marked cells / all cells
+    size_t tabletBytes;   // INSERT_TABLET
+    size_t recordsBytes;  // INSERT_RECORDS
+    size_t groupsBytes;   // INSERT_COLUMN_GROUPS, all requests together
+    // columns with equal bitmaps, all unmarked columns are left out
+    std::vector<std::vector<size_t> > groups;
+
+    InsertEstimate()
+        : density(1.0), tabletBytes(0), recordsBytes(0), groupsBytes(0) {}
+
+    InsertEncoding cheapest() const {
+        if (recordsBytes < tabletBytes && recordsBytes <= groupsBytes) {
+            return INSERT_RECORDS;
+        }
+        return groupsBytes < tabletBytes ? INSERT_COLUMN_GROUPS
+                                         : INSERT_TABLET;
+    }
+};
+
+/** ------- end insert encodings of a Tablet ------ */
+
+/** ------- string arena in Tablet ------ */
+// TEXT cell of a Tablet, pointing into the string arena of the tablet
+struct TextRef {
+    static const uint32_t NO_CODE = 0xffffffffu;
+
+    const char *data;
+    uint32_t length;
+    uint32_t code;  // dictionary code, NO_CODE if not dictionary encoded
+
+    TextRef() : data(""), length(0), code(NO_CODE) {}
+
+    std::string str() const { return std::string(data, length); }
+};
+
+// Append only byte storage. Copied strings never move, the memory is only
+// returned by clear(), which keeps the first block for reuse.
+class StringArena {
+   public:
+    static const size_t BLOCK_BYTES = 64 << 10;
+
+    StringArena() : used_(0) {}
+    ~StringArena();
+
+    const char *copy(const char *data, size_t length);
+    void clear();
+
+   private:
+    StringArena(const StringArena &);
+    StringArena &operator=(const StringArena &);
+
+    std::vector<char *> blocks_;
+    size_t used_;  // bytes used in blocks_.back()
+};
+
+/** ------- end string arena in Tablet ------ */
+
 /** ------ tablet ------ */
 class Tablet {
    private:
     static const int DEFAULT_ROW_SIZE = 1024;
+    // runs are only given up once there are enough of them to matter
+    static const size_t MIN_TIMESTAMP_RUNS = 16;
+
+    // rows [firstRow, next run's firstRow) have timestamps start + k * interval
+    struct TimestampRun {
+        size_t firstRow;
+        int64_t start;
+        int64_t interval;
+    };
 
     void createColumns();
     void deleteColumns();
+    int64_t getRunTimestamp(size_t row) const;
+    void expandTimestampRuns();
+    void appendTimestampRun(int64_t timestamp);
+    void appendJsonCell(std::string &out, size_t schemaId, size_t row) const;
+    // rows of `source` in timestamp order, see sortByTime()
+    size_t gatherSortedRows(const Tablet &source, bool dedup);
+    void clearText();
+    // clear the TEXT cells of the rows from rowSize to `oldRowSize` that a
+    // compaction left behind, and count textBytes_ again
+    void recountTextBytes(size_t oldRowSize);
+    const TextRef *findDictionaryText(const char *data, size_t length);
 
    public:
     std::string deviceId;  // deviceId of this tablet
     std::vector<std::pair<std::string, TSDataType> >
         schemas;  // the list of measurement schemas for creating the tablet
-    std::vector<int64_t> timestamps;  // timestamps in this tablet
+    // timestamps in this tablet; empty while setTimestampCompression() is
+    // on, then rows must go through appendTimestamp() and getTimestamp()
+    std::vector<int64_t> timestamps;
     std::vector<void *> values;  // each object is a primitive type array, which
-                                 // represents values of one measurement
+                                 // represents values of one measurement,
+                                 // a TextRef array for TEXT
     std::vector<BitMap> bitMaps;  // each bitmap represents the existence of
                                   // each value in the current column
     size_t rowSize;       // the number of rows to include in this tablet
@@ -227,7 +426,14 @@ class Tablet {
     bool isAligned;  // whether this tablet store data of aligned timeseries or
                      // not
 
-    Tablet() {}
+    Tablet()
+        : rowSize(0),
+          maxRowNumber(0),
+          isAligned(false),
+          compressTimestamps_(false),
+          timestampsAreRuns_(false),
+          maxDictionaryEntries_(0),
+          textBytes_(0) {}
 
     /**
      * Return a tablet with default specified row number. This is the standard
@@ -238,7 +444,13 @@ class Tablet {
      */
     Tablet(const std::string &deviceId,
            const std::vector<std::pair<std::string, TSDataType> > &timeseries)
-        : deviceId(deviceId), schemas(timeseries) {
+        : deviceId(deviceId),
+          schemas(timeseries),
+          isAligned(false),
+          compressTimestamps_(false),
+          timestampsAreRuns_(false),
+          maxDictionaryEntries_(0),
+          textBytes_(0) {
         maxRowNumber = DEFAULT_ROW_SIZE;
         init();
     }
@@ -259,14 +471,25 @@ class Tablet {
         : deviceId(deviceId),
           schemas(schemas),
           maxRowNumber(maxRowNumber),
-          isAligned(_isAligned) {
+          isAligned(_isAligned),
+          compressTimestamps_(false),
+          timestampsAreRuns_(false),
+          maxDictionaryEntries_(0),
+          textBytes_(0) {
         init();
     }
 
     void init() {
         timestamps.resize(maxRowNumber);
+        timestampRuns_.clear();
+        timestampsAreRuns_ = false;
+        if (compressTimestamps_) {
+            std::vector<int64_t>().swap(timestamps);
+            timestampsAreRuns_ = true;
+        }
         values.resize(schemas.size());
         createColumns();
+        clearText();
         bitMaps.resize(schemas.size());
         for (size_t i = 0; i < schemas.size(); i++) {
             bitMaps[i].resize(maxRowNumber);
@@ -274,12 +497,128 @@ class Tablet {
         this->rowSize = 0;
     }
 
+    /**
+     * Release the current columns and rebuild the tablet for a new device and
+     * schema list, e.g. when the shape of a query result is only known after
+     * the response arrived.
+     */
+    void init(const std::string &deviceId,
+              const std::vector<std::pair<std::string, TSDataType> > &schemas,
+              size_t maxRowNumber) {
+        deleteColumns();
+        this->deviceId = deviceId;
+        this->schemas = schemas;
+        this->maxRowNumber = maxRowNumber;
+        init();
+    }
+
     ~Tablet() { deleteColumns(); }
 
+    // TEXT values are passed as std::string *
     bool addValue(size_t schemaId, size_t rowIndex, void *value);
 
+    // copy a TEXT value into the tablet, allocating only for a new arena block
+    bool addText(size_t schemaId, size_t rowIndex, const char *data,
+                 size_t length);
+    const TextRef &getText(size_t schemaId, size_t rowIndex) const {
+        return ((const TextRef *)values[schemaId])[rowIndex];
+    }
+
+    /**
+     * Store the first `maxEntries` distinct TEXT values of the tablet once
+     * and let every cell with such a value refer to that copy, which also
+     * escapes it for serializeJson() only once. Meant for status and enum
+     * like columns; later values are stored plainly. 0 disables it. Cells
+     * added before keep their text but are no longer coded.
+     */
+    void setTextDictionary(size_t maxEntries);
+
+    /**
+     * Store timestamps added with appendTimestamp() as runs of
+     * start + k * interval, which is what fixed rate sampling produces: a
+     * timestamp that does not continue the current run starts a new one, and
+     * a tablet whose runs would take more memory than plain timestamps
+     * switches back to them until reset(). While runs are used `timestamps`
+     * is empty, so add rows with appendTimestamp() and read them through
+     * getTimestamp(); init() keeps the setting. Drops the current rows.
+     */
+    void setTimestampCompression(bool enable);
+    bool isTimestampCompressed() const { return timestampsAreRuns_; }
+
+    // add a row with `timestamp` and no values, false if the tablet is full
+    bool appendTimestamp(int64_t timestamp) {
+        if (rowSize >= maxRowNumber) {
+            return false;
+        }
+        if (!timestampsAreRuns_) {
+            timestamps[rowSize++] = timestamp;
+            return true;
+        }
+        appendTimestampRun(timestamp);
+        return true;
+    }
+
+    // appendTimestamp() for `count` timestamps, false if they do not fit
+    bool appendTimestamps(const int64_t *timestamps, size_t count) {
+        if (count > maxRowNumber - rowSize) {
+            return false;
+        }
+        if (!timestampsAreRuns_) {
+            memcpy(&this->timestamps[rowSize], timestamps,
+                   count * sizeof(int64_t));
+            rowSize += count;
+            return true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            appendTimestampRun(timestamps[i]);
+        }
+        return true;
+    }
+
+    int64_t getTimestamp(size_t row) const {
+        return timestampsAreRuns_ ? getRunTimestamp(row) : timestamps[row];
+    }
+
+    // move the rows with at least one marked cell to the front and drop
+    // the others, returns the number of dropped rows
+    size_t removeUnmarkedRows();
+
+    // timestamps ascend, `strict` also rejects duplicate timestamps
+    bool isSortedByTime(bool strict) const;
+
+    /**
+     * Sort the rows by timestamp with a stable radix sort and move every
+     * column and bitmap along, so that the server takes the sequence write
+     * path. With `dedup` rows with equal timestamps are merged into one,
+     * each cell taking the value of the last row that marked it. Compressed
+     * timestamps are expanded first. Returns the number of merged rows.
+     */
+    size_t sortByTime(bool dedup);
+    // rebuild this tablet as the rows of `source` sorted by sortByTime(),
+    // reusing the columns if it already has the schemas and enough rows
+    size_t assignSortedByTime(const Tablet &source, bool dedup);
+
     Json::Value toJson() const;
 
+    // insertTablet request body, equivalent to writing toJson() out
+    void serializeJson(std::string &out) const;
+    // insertTablet request body of `columns`, restricted to the rows in
+    // which at least one of them is marked
+    void serializeJson(std::string &out,
+                       const std::vector<size_t> &columns) const;
+    // insertRecords request body with one record per row that has marked
+    // cells, listing only the marked cells
+    void serializeRecordsJson(std::string &out) const;
+
+    /**
+     * Measure the null density from the bitmaps and estimate the request
+     * size of each InsertEncoding without serializing anything. A wide
+     * tablet whose rows set only a few measurements is mostly "null" text
+     * as an insertTablet, while insertRecords repeats names and types for
+     * every cell; column groups pay off when series report together.
+     */
+    void estimateInsert(InsertEstimate &estimate) const;
+
     void reset();  // Reset Tablet to the default state - set the rowSize to 0
 
     size_t getTimeBytesSize();
@@ -287,11 +626,78 @@ class Tablet {
     size_t getValueByteSize();  // total byte size that values occupies
 
     void setAligned(bool isAligned);
+
+   private:
+    bool compressTimestamps_;  // store appended timestamps as runs
+    bool timestampsAreRuns_;   // timestampRuns_ is in use, timestamps empty
+    std::vector<TimestampRun> timestampRuns_;
+
+    StringArena textArena_;
+    size_t maxDictionaryEntries_;
+    std::vector<TextRef> dictionary_;           // indexed by code
+    std::vector<std::string> dictionaryJson_;   // escaped form of each entry
+    std::vector<uint32_t> dictionarySlots_;     // hash table of code + 1
+    size_t textBytes_;  // length of all TEXT values currently stored
 };
 
 /** ------ end tablet ------ */
 
+/** ------ last value cache ------ */
+// monotonic clock used for cache expiry and latency measurement
+uint64_t monotonicMicros();
+
+/**
+ * Latest (timestamp, value) of each series path, fed by the writes and
+ * latest-value reads of a RestClient. Entries expire after `ttlMs` (0 keeps
+ * them forever) and the least recently used entry is dropped once more than
+ * `maxEntries` series are cached. Not thread safe, like RestClient itself.
+ */
+class LastValueCache {
+   public:
+    LastValueCache(size_t maxEntries, uint64_t ttlMs)
+        : maxEntries_(maxEntries), ttlMicros_(ttlMs * 1000), hits_(0),
+          misses_(0) {}
+
+    // keep `value` unless the cached point of `path` is newer
+    void update(const std::string &path, int64_t timestamp,
+                const Json::Value &value);
+
+    // return the cached value of `path`, NULL on a miss or an expired entry
+    const Json::Value *lookup(const std::string &path, int64_t &timestamp);
+
+    void erase(const std::string &path);
+    void clear();
+
+    size_t size() const { return entries_.size(); }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+   private:
+    struct Entry {
+        int64_t timestamp;
+        Json::Value value;
+        uint64_t updatedAt;
+        std::list<const std::string *>::iterator lruPos;
+    };
+
+    void touch(Entry &entry);
+
+    size_t maxEntries_;
+    uint64_t ttlMicros_;
+    uint64_t hits_;
+    uint64_t misses_;
+    std::map<std::string, Entry> entries_;
+    std::list<const std::string *> lru_;  // keys of entries_, most recent first
+};
+
+/** ------ end last value cache ------ */
+
 /** ------ rest client ------ */
+class QueryResultCache;
+class SegmentedResult;
+struct DeviceQuery;
+class DeviceTablets;
+
 static const std::string root_path = "root";
 static const std::string create_timeseries_req =
     "create timeseries %s WITH DATATYPE=%s, ENCODING=%s, COMPRESSOR=%s";
@@ -320,20 +726,61 @@ class RestClient {
         headers_ = curl_slist_append(
             headers_, ("Authorization: Basic " + encoded_credentials).c_str());
         url_base_ = "http://" + ip + ":" + to_string(port);
-        curl_global_init(CURL_GLOBAL_DEFAULT);
+        context_ = ClientContext::acquire();
         curl_connection_ = curl_easy_init();
+        last_value_cache_ = NULL;
+        query_cache_ = NULL;
+        timeout_ms_ = 0;
+        sparse_insert_ = false;
+        sort_before_insert_ = false;
     }
 
     ~RestClient() {
+        delete last_value_cache_;
         curl_slist_free_all(headers_);
         if (curl_connection_) {
             curl_easy_cleanup(curl_connection_);
         }
-        curl_global_cleanup();
+        ClientContext::release();
     }
     // check connection between client and IoTDB
     bool pingIoTDB();
 
+    // fail requests that take longer than `timeoutMs`, 0 waits forever
+    void setTimeout(long timeoutMs) { timeout_ms_ = timeoutMs; }
+
+    /**
+     * Let insertTablet() send each tablet in the InsertEncoding estimated
+     * to be smallest instead of always as a dense insertTablet. Column
+     * groups take several requests, a failure of one of them does not undo
+     * the groups written before.
+     */
+    void setSparseInsert(bool enable) { sparse_insert_ = enable; }
+
+    // let insertTablet() send tablets whose timestamps are out of order or
+    // repeat as a sorted and deduplicated copy, see Tablet::sortByTime()
+    void setSortBeforeInsert(bool enable) { sort_before_insert_ = enable; }
+
+    /**
+     * Remember the newest point of every series this client writes or reads
+     * with queryTimeseriesLatestValue, so that latest value reads of those
+     * series are answered locally. Points written by other clients are only
+     * seen once the entry expired after `ttlMs`.
+     */
+    void enableLastValueCache(size_t maxEntries, uint64_t ttlMs);
+    void disableLastValueCache();
+    const LastValueCache *getLastValueCache() const {
+        return last_value_cache_;
+    }
+
+    /**
+     * Serve runQuery() and the queries built on it from `cache`, which may
+     * be shared with other clients and threads. The cache is owned by the
+     * caller and must outlive the client; pass NULL to stop using it.
+     * Writes of this client do not invalidate cached results.
+     */
+    void setQueryCache(QueryResultCache *cache) { query_cache_ = cache; }
+
     // create database
     bool createDatabase(std::string path);
 
@@ -382,6 +829,10 @@ class RestClient {
                               << std::endl;
                     return false;
                 }
+                if (last_value_cache_) {
+                    last_value_cache_->update(device_path + "." + measurement,
+                                              timestamp, Json::Value(value));
+                }
                 return true;
             }
             return false;
@@ -389,16 +840,70 @@ class RestClient {
         return false;
     }
     bool insertTablet(const Tablet &tablet);
+    // send an already serialized insertTablet request body
+    bool insertTabletPayload(const std::string &json_data);
+    // send an already serialized insertRecords request body
+    bool insertRecordsPayload(const std::string &json_data);
 
-    // query data from timeseries
+    // query data from timeseries, `tablet` is rebuilt to hold exactly the
+    // rows of [begin, end] in one column named `measurement_name`
     bool queryTimeseriesByTime(std::string device_path,
                                std::string measurement_name,
                                TSDataType data_type, uint64_t begin,
                                uint64_t end, Tablet &tablet);
+    // same query into chunked storage, which grows with the result instead
+    // of being copied into one allocation
+    bool queryTimeseriesByTime(std::string device_path,
+                               std::string measurement_name,
+                               TSDataType data_type, uint64_t begin,
+                               uint64_t end, SegmentedResult &result);
+    /**
+     * Query server side aggregations of one timeseries grouped into windows
+     * of `interval` milliseconds over [begin, end), i.e.
+     * "select avg(s1), ... group by ([begin, end), interval)".
+     *
+     * `tablet` is rebuilt to hold one row per window and one column per
+     * aggregation, named like "AVG(s1)" and typed by AggregationResultType.
+     * Empty windows are left unmarked in the bitmaps.
+     */
+    bool queryAggregation(std::string device_path,
+                          std::string measurement_name, TSDataType data_type,
+                          const std::vector<AggregationType> &aggregations,
+                          uint64_t begin, uint64_t end, uint64_t interval,
+                          Tablet &tablet);
+    /**
+     * M4 downsampling with the server's M4 function: the first, last,
+     * smallest and largest point of every window of `interval` milliseconds
+     * over [begin, end), each at its own timestamp, which is enough to draw
+     * a line chart with one window per pixel. `tablet` is rebuilt with one
+     * column named `measurement_name` and one row per representative point,
+     * up to four per window in time order.
+     */
+    bool queryM4(std::string device_path, std::string measurement_name,
+                 TSDataType data_type, uint64_t begin, uint64_t end,
+                 uint64_t interval, Tablet &tablet);
+    /**
+     * Read the same measurements of many devices with one align by device
+     * statement, see DeviceQuery. `result` is rebuilt with one Tablet per
+     * device in response order, each holding the selected measurements;
+     * null cells are left unmarked.
+     */
+    bool queryAlignByDevice(const DeviceQuery &query, DeviceTablets &result);
     template <typename T>
     bool queryTimeseriesLatestValue(std::string device_path,
                                     std::string measurement_name,
                                     uint64_t &timestamp, T &value) {
+        std::string path = device_path + "." + measurement_name;
+        if (last_value_cache_) {
+            int64_t cached_timestamp;
+            const Json::Value *cached =
+                last_value_cache_->lookup(path, cached_timestamp);
+            if (cached) {
+                timestamp = cached_timestamp;
+                value = parseJsonValue<T>(*cached);
+                return true;
+            }
+        }
         std::ostringstream oss;
         oss << "select last " << measurement_name << " from " << device_path;
         Json::Value resp;
@@ -408,8 +913,16 @@ class RestClient {
         std::cout << resp.toStyledString() << std::endl;
         const Json::Value timestamps = resp["timestamps"];
         const Json::Value values = resp["values"];
+        if (timestamps.empty()) {
+            std::cout << "no data in " << path << std::endl;
+            return false;
+        }
         timestamp = timestamps[0].asUInt64();
         value = parseJsonValue<T>(values[1][0]);
+        if (last_value_cache_) {
+            last_value_cache_->update(path, timestamps[0].asInt64(),
+                                      values[1][0]);
+        }
         return true;
     }
 
@@ -417,12 +930,29 @@ class RestClient {
     int runNonQuery(std::string sql, std::string &errmesg);
 
    private:
+    // decodes its query responses with decodeColumn()
+    friend class SeriesFollower;
+
+    bool runQueryUncached(const std::string &sql, Json::Value &value);
     bool curl_perfrom(std::string api, std::string data, Json::Value &value,
                       bool need_auth_info = true, bool is_post = true);
     bool validatePath(std::string path);
     template <typename T>
     T parseJsonValue(const Json::Value &value);
+    // decode cells [first, first + tablet.rowSize) of one column of a query
+    // response into column `schemaId` of `tablet`, null cells stay unmarked
+    void decodeColumn(const Json::Value &column, size_t first, size_t schemaId,
+                      Tablet &tablet);
+    // feed the newest marked point of every column into last_value_cache_
+    void updateLastValueCache(const Tablet &tablet);
+    ClientContext *context_;  // DNS, connections and TLS sessions
     CURL *curl_connection_;
+    LastValueCache *last_value_cache_;
+    QueryResultCache *query_cache_;
+    long timeout_ms_;
+    bool sparse_insert_;
+    bool sort_before_insert_;
+    Tablet sorted_;  // reused copy of unsorted tablets for insertTablet()
     std::string username_;
     std::string password_;
     struct curl_slist *headers_;
@@ -0,0 +1,82 @@
+#include "segmented_result.h"
+
+#include <string.h>
+
+namespace rest_client {
+
+/** ------ segmented result defination ------ */
+const size_t SegmentedResult::DEFAULT_CHUNK_ROWS;
+
+SegmentedResult::SegmentedResult(size_t chunkRows)
+    : chunkRows_(chunkRows == 0 ? 1 : chunkRows), rowCount_(0) {}
+
+void SegmentedResult::reset(
+    const std::string& deviceId,
+    const std::vector<std::pair<std::string, TSDataType> >& schemas) {
+    clear();
+    deviceId_ = deviceId;
+    schemas_ = schemas;
+}
+
+void SegmentedResult::clear() {
+    for (size_t i = 0; i < chunks_.size(); i++) {
+        delete chunks_[i];
+    }
+    chunks_.clear();
+    rowCount_ = 0;
+}
+
+size_t SegmentedResult::appendRow(int64_t timestamp) {
+    if (rowCount_ == chunks_.size() * chunkRows_) {
+        chunks_.push_back(new Tablet(deviceId_, schemas_, chunkRows_));
+    }
+    Tablet& chunk = *chunks_.back();
+    chunk.timestamps[chunk.rowSize++] = timestamp;
+    return rowCount_++;
+}
+
+bool SegmentedResult::addValue(size_t schemaId, size_t row, void* value) {
+    if (row >= rowCount_) {
+        std::cout << "SegmentedResult::addValue(), row >= rowCount. row="
+                  << row << ", rowCount=" << rowCount_ << "." << std::endl;
+        return false;
+    }
+    Tablet& chunk = *chunks_[row / chunkRows_];
+    size_t offset = row % chunkRows_;
+    if (!chunk.addValue(schemaId, offset, value)) {
+        return false;
+    }
+    chunk.bitMaps[schemaId].mark(offset);
+    return true;
+}
+
+void SegmentedResult::consolidate(Tablet& tablet) const {
+    tablet.init(deviceId_, schemas_, rowCount_);
+    size_t row = 0;
+    for (size_t c = 0; c < chunks_.size(); c++) {
+        const Tablet& chunk = *chunks_[c];
+        tablet.appendTimestamps(&chunk.timestamps[0], chunk.rowSize);
+        for (size_t i = 0; i < schemas_.size(); i++) {
+            size_t width = DatatypeFixedWidth(schemas_[i].second);
+            if (width != 0) {
+                memcpy((char*)tablet.values[i] + row * width, chunk.values[i],
+                       chunk.rowSize * width);
+            }
+            for (size_t j = 0; j < chunk.rowSize; j++) {
+                if (!chunk.bitMaps[i].isMarked(j)) {
+                    continue;
+                }
+                if (width == 0) {
+                    const TextRef& text = chunk.getText(i, j);
+                    tablet.addText(i, row + j, text.data, text.length);
+                }
+                tablet.bitMaps[i].mark(row + j);
+            }
+        }
+        row += chunk.rowSize;
+    }
+}
+
+/** ------ end segmented result defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,136 @@
+#ifndef SEGMENTED_RESULT_H
+#define SEGMENTED_RESULT_H
+
+#include <string>
+#include <vector>
+
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ segmented result ------ */
+/**
+ * Query result of unknown size, stored as a list of Tablets ("chunks") of
+ * `chunkRows` rows each. Appending a row past the last chunk allocates a new
+ * chunk and never moves the rows already stored, so a result can grow to any
+ * size without guessing it up front.
+ *
+ * Row `row` lives in chunk row / chunkRows at offset row % chunkRows. Null
+ * cells stay unmarked in the bitmaps of their chunk, like in a Tablet.
+ */
+class SegmentedResult {
+   public:
+    static const size_t DEFAULT_CHUNK_ROWS = 4096;
+
+    // forward cursor over the rows, cheaper than random access per row
+    class ConstIterator {
+       public:
+        ConstIterator() : result_(NULL), chunk_(0), offset_(0) {}
+
+        size_t row() const { return chunk_ * result_->chunkRows_ + offset_; }
+        int64_t timestamp() const {
+            return result_->chunks_[chunk_]->timestamps[offset_];
+        }
+        bool isNull(size_t column) const {
+            return !result_->chunks_[chunk_]->bitMaps[column].isMarked(offset_);
+        }
+        // T must match the column type, read TEXT with getText()
+        template <typename T>
+        const T &getValue(size_t column) const {
+            return ((const T *)result_->chunks_[chunk_]->values[column])
+                [offset_];
+        }
+        const TextRef &getText(size_t column) const {
+            return result_->chunks_[chunk_]->getText(column, offset_);
+        }
+
+        ConstIterator &operator++() {
+            if (++offset_ == result_->chunkRows_) {
+                chunk_++;
+                offset_ = 0;
+            }
+            return *this;
+        }
+        bool operator==(const ConstIterator &other) const {
+            return chunk_ == other.chunk_ && offset_ == other.offset_;
+        }
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+
+       private:
+        friend class SegmentedResult;
+        ConstIterator(const SegmentedResult *result, size_t row)
+            : result_(result),
+              chunk_(row / result->chunkRows_),
+              offset_(row % result->chunkRows_) {}
+
+        const SegmentedResult *result_;
+        size_t chunk_;
+        size_t offset_;
+    };
+
+    explicit SegmentedResult(size_t chunkRows = DEFAULT_CHUNK_ROWS);
+    ~SegmentedResult() { clear(); }
+
+    // drop all rows and take the shape of a new result
+    void reset(const std::string &deviceId,
+               const std::vector<std::pair<std::string, TSDataType> > &schemas);
+    // drop all rows and release the chunks, the shape is kept
+    void clear();
+
+    // append a row without values and return its index
+    size_t appendRow(int64_t timestamp);
+    // store and mark one cell of an appended row, see Tablet::addValue()
+    bool addValue(size_t schemaId, size_t row, void *value);
+
+    const std::string &getDeviceId() const { return deviceId_; }
+    const std::vector<std::pair<std::string, TSDataType> > &getSchemas()
+        const {
+        return schemas_;
+    }
+    size_t rowCount() const { return rowCount_; }
+    size_t chunkRows() const { return chunkRows_; }
+    size_t chunkCount() const { return chunks_.size(); }
+    // chunk `index` holds its first rowSize rows of the result
+    const Tablet &getChunk(size_t index) const { return *chunks_[index]; }
+    Tablet &getChunk(size_t index) { return *chunks_[index]; }
+
+    int64_t getTimestamp(size_t row) const {
+        return chunks_[row / chunkRows_]->timestamps[row % chunkRows_];
+    }
+    bool isNull(size_t row, size_t column) const {
+        return !chunks_[row / chunkRows_]->bitMaps[column].isMarked(
+            row % chunkRows_);
+    }
+    // T must match the column type, read TEXT with getText()
+    template <typename T>
+    const T &getValue(size_t row, size_t column) const {
+        return ((const T *)chunks_[row / chunkRows_]->values[column])
+            [row % chunkRows_];
+    }
+    const TextRef &getText(size_t row, size_t column) const {
+        return chunks_[row / chunkRows_]->getText(column, row % chunkRows_);
+    }
+
+    ConstIterator begin() const { return ConstIterator(this, 0); }
+    ConstIterator end() const { return ConstIterator(this, rowCount_); }
+
+    // rebuild `tablet` as one contiguous copy of all rows
+    void consolidate(Tablet &tablet) const;
+
+   private:
+    SegmentedResult(const SegmentedResult &);
+    SegmentedResult &operator=(const SegmentedResult &);
+
+    size_t chunkRows_;
+    size_t rowCount_;
+    std::string deviceId_;
+    std::vector<std::pair<std::string, TSDataType> > schemas_;
+    std::vector<Tablet *> chunks_;
+};
+
+/** ------ end segmented result ------ */
+
+}  // namespace rest_client
+#endif  // SEGMENTED_RESULT_H
@@ -0,0 +1,284 @@
+#include "series_follower.h"
+
+#include <set>
+
+namespace rest_client {
+
+/** ------ series follower defination ------ */
+SeriesFollower::SeriesFollower(RestClient* client, FollowerListener* listener,
+                               const FollowerOptions& options)
+    : client_(client),
+      listener_(listener),
+      options_(options),
+      running_(false),
+      stopping_(false) {
+    if (options_.maxDevicesPerQuery == 0) options_.maxDevicesPerQuery = 1;
+}
+
+SeriesFollower::~SeriesFollower() { stop(); }
+
+void SeriesFollower::follow(const std::string& device,
+                            const std::string& measurement, TSDataType type,
+                            int64_t after) {
+    MutexLock lock(mutex_);
+    std::vector<Series>& series = devices_[device];
+    for (size_t i = 0; i < series.size(); i++) {
+        if (series[i].measurement == measurement) {
+            series[i].type = type;
+            series[i].lastSeen = after;
+            return;
+        }
+    }
+    Series added;
+    added.measurement = measurement;
+    added.type = type;
+    added.lastSeen = after;
+    series.push_back(added);
+}
+
+void SeriesFollower::unfollow(const std::string& device,
+                              const std::string& measurement) {
+    MutexLock lock(mutex_);
+    DeviceMap::iterator it = devices_.find(device);
+    if (it == devices_.end()) {
+        return;
+    }
+    std::vector<Series>& series = it->second;
+    for (size_t i = 0; i < series.size(); i++) {
+        if (series[i].measurement == measurement) {
+            series.erase(series.begin() + i);
+            break;
+        }
+    }
+    if (series.empty()) {
+        devices_.erase(it);
+    }
+}
+
+bool SeriesFollower::lastSeen(const std::string& device,
+                              const std::string& measurement,
+                              int64_t& timestamp) {
+    MutexLock lock(mutex_);
+    DeviceMap::iterator it = devices_.find(device);
+    if (it == devices_.end()) {
+        return false;
+    }
+    for (size_t i = 0; i < it->second.size(); i++) {
+        if (it->second[i].measurement == measurement) {
+            timestamp = it->second[i].lastSeen;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SeriesFollower::poll() {
+    // poll a copy, so that the listener may change the followed series
+    MutexLock polling(pollMutex_);
+    DeviceMap before;
+    {
+        MutexLock lock(mutex_);
+        before = devices_;
+    }
+    DeviceMap polled = before;
+    bool ok = true;
+    DeviceMap::iterator first = polled.begin();
+    while (first != polled.end()) {
+        DeviceMap::iterator last = first;
+        for (size_t i = 0;
+             i < options_.maxDevicesPerQuery && last != polled.end(); i++) {
+            ++last;
+        }
+        if (!pollGroup(first, last)) {
+            ok = false;
+        }
+        first = last;
+    }
+    storeLastSeen(before, polled);
+    return ok;
+}
+
+void SeriesFollower::storeLastSeen(const DeviceMap& before,
+                                   const DeviceMap& polled) {
+    MutexLock lock(mutex_);
+    DeviceMap::const_iterator it;
+    for (it = polled.begin(); it != polled.end(); ++it) {
+        DeviceMap::iterator current = devices_.find(it->first);
+        if (current == devices_.end()) {
+            continue;
+        }
+        const std::vector<Series>& old = before.find(it->first)->second;
+        for (size_t i = 0; i < it->second.size(); i++) {
+            const Series& s = it->second[i];
+            for (size_t j = 0; j < current->second.size(); j++) {
+                Series& target = current->second[j];
+                if (target.measurement == s.measurement) {
+                    // follow() during the poll moved the start, keep it
+                    if (target.lastSeen == old[i].lastSeen &&
+                        target.type == s.type) {
+                        target.lastSeen = s.lastSeen;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool SeriesFollower::pollGroup(DeviceMap::iterator first,
+                               DeviceMap::iterator last) {
+    // one request covers the union of the measurements over all devices of
+    // the group, starting after the oldest last seen point of any of them
+    std::set<std::string> measurements;
+    int64_t cursor = 0;
+    bool hasCursor = false;
+    std::string from;
+    for (DeviceMap::iterator it = first; it != last; ++it) {
+        from += (from.empty() ? "" : ", ") + it->first;
+        for (size_t i = 0; i < it->second.size(); i++) {
+            measurements.insert(it->second[i].measurement);
+            if (!hasCursor || it->second[i].lastSeen < cursor) {
+                cursor = it->second[i].lastSeen;
+                hasCursor = true;
+            }
+        }
+    }
+    std::string select;
+    for (std::set<std::string>::iterator it = measurements.begin();
+         it != measurements.end(); ++it) {
+        select += (select.empty() ? "" : ", ") + *it;
+    }
+
+    while (true) {
+        std::ostringstream oss;
+        oss << "select " << select << " from " << from << " where time > "
+            << cursor;
+        if (options_.maxRowsPerQuery != 0) {
+            oss << " limit " << options_.maxRowsPerQuery;
+        }
+        Json::Value response;
+        if (!client_->runQuery(oss.str(), response)) {
+            return false;
+        }
+        if (response.isMember("code")) {
+            std::cout << "SeriesFollower: query failed: "
+                      << response["message"].asString() << std::endl;
+            return false;
+        }
+        const Json::Value& expressions = response["expressions"];
+        const Json::Value& timestamps = response["timestamps"];
+        std::map<std::string, size_t> columns;
+        for (Json::ArrayIndex i = 0; i < expressions.size(); i++) {
+            columns[expressions[i].asString()] = i;
+        }
+        for (DeviceMap::iterator it = first; it != last; ++it) {
+            deliver(it->first, it->second, response, columns);
+        }
+        if (timestamps.size() != 0) {
+            cursor = timestamps[timestamps.size() - 1].asInt64();
+        }
+        if (options_.maxRowsPerQuery == 0 ||
+            timestamps.size() < options_.maxRowsPerQuery) {
+            break;
+        }
+    }
+    // the server returned every point of the group up to `cursor`
+    for (DeviceMap::iterator it = first; it != last; ++it) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            if (it->second[i].lastSeen < cursor) {
+                it->second[i].lastSeen = cursor;
+            }
+        }
+    }
+    return true;
+}
+
+void SeriesFollower::deliver(const std::string& device,
+                             std::vector<Series>& series,
+                             const Json::Value& response,
+                             const std::map<std::string, size_t>& columns) {
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    std::vector<size_t> followed;  // series index of each schema
+    std::vector<size_t> responseColumns;
+    for (size_t i = 0; i < series.size(); i++) {
+        std::map<std::string, size_t>::const_iterator column =
+            columns.find(device + "." + series[i].measurement);
+        if (column != columns.end()) {
+            schemas.push_back(
+                std::make_pair(series[i].measurement, series[i].type));
+            followed.push_back(i);
+            responseColumns.push_back(column->second);
+        }
+    }
+    if (schemas.empty()) {
+        return;
+    }
+
+    const Json::Value& timestamps = response["timestamps"];
+    const Json::Value& values = response["values"];
+    points_.init(device, schemas, timestamps.size());
+    for (Json::ArrayIndex row = 0; row < timestamps.size(); row++) {
+        points_.appendTimestamp(timestamps[row].asInt64());
+    }
+    for (size_t i = 0; i < schemas.size(); i++) {
+        Series& s = series[followed[i]];
+        client_->decodeColumn(values[(Json::ArrayIndex)responseColumns[i]], 0,
+                              i, points_);
+        int64_t newest = s.lastSeen;
+        for (size_t row = 0; row < points_.rowSize; row++) {
+            if (points_.getTimestamp(row) <= s.lastSeen) {
+                points_.bitMaps[i].unmark(row);
+            } else if (points_.bitMaps[i].isMarked(row) &&
+                       points_.getTimestamp(row) > newest) {
+                newest = points_.getTimestamp(row);
+            }
+        }
+        s.lastSeen = newest;
+    }
+    points_.removeUnmarkedRows();
+    if (points_.rowSize != 0 && listener_) {
+        listener_->onPoints(points_);
+    }
+}
+
+void SeriesFollower::start() {
+    if (running_) {
+        return;
+    }
+    stopping_ = false;
+    running_ = true;
+    pthread_create(&thread_, NULL, runPolling, this);
+}
+
+void SeriesFollower::stop() {
+    if (!running_) {
+        return;
+    }
+    {
+        MutexLock lock(stopMutex_);
+        stopping_ = true;
+        stopCondition_.broadcast();
+    }
+    pthread_join(thread_, NULL);
+    running_ = false;
+}
+
+void* SeriesFollower::runPolling(void* arg) {
+    SeriesFollower& follower = *(SeriesFollower*)arg;
+    while (true) {
+        follower.poll();
+        MutexLock lock(follower.stopMutex_);
+        if (!follower.stopping_) {
+            follower.stopCondition_.waitFor(follower.stopMutex_,
+                                            follower.options_.intervalMs);
+        }
+        if (follower.stopping_) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/** ------ end series follower defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,111 @@
+#ifndef SERIES_FOLLOWER_H
+#define SERIES_FOLLOWER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "concurrency.h"
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ series follower ------ */
+struct FollowerOptions {
+    uint64_t intervalMs;        // pause between two polls of start()
+    size_t maxDevicesPerQuery;  // devices fetched by one request
+    size_t maxRowsPerQuery;     // "limit" of one request, further pages follow
+
+    FollowerOptions()
+        : intervalMs(1000), maxDevicesPerQuery(16), maxRowsPerQuery(10000) {}
+};
+
+class FollowerListener {
+   public:
+    virtual ~FollowerListener() {}
+
+    // new points of one device: one column per followed series that got
+    // points, cells that are not new are unmarked. Called by poll() without
+    // the follower's lock, so it may call follow(), unfollow() and
+    // lastSeen(), but not poll() or stop()
+    virtual void onPoints(const Tablet &points) = 0;
+};
+
+/**
+ * Tail a set of series instead of re-reading a sliding window.
+ *
+ * The follower remembers up to which timestamp every series was read and
+ * only asks for "time > last seen": every poll sends one query per group of
+ * up to maxDevicesPerQuery devices, starting after the oldest last seen
+ * timestamp of the group, e.g.
+ *
+ *   select s1, s2 from root.sg.d1, root.sg.d2 where time > 1000 limit 10000
+ *
+ * so a poll costs in proportion to the new points, not to the window shown.
+ * Once a query returned everything up to its newest timestamp, every series
+ * of the group counts as read up to there, so a series without new points
+ * does not hold the next query of its group back. Points that reach the
+ * server later with a timestamp at or before the last seen one of their
+ * series are not delivered.
+ */
+class SeriesFollower {
+   public:
+    SeriesFollower(RestClient *client, FollowerListener *listener,
+                   const FollowerOptions &options = FollowerOptions());
+    ~SeriesFollower();  // stop()
+
+    // deliver points of the series newer than `after`
+    void follow(const std::string &device, const std::string &measurement,
+                TSDataType type, int64_t after);
+    void unfollow(const std::string &device, const std::string &measurement);
+    // timestamp the series was read up to: `after`, the newest point
+    // delivered, or the newest point of its group; false if not followed
+    bool lastSeen(const std::string &device, const std::string &measurement,
+                  int64_t &timestamp);
+
+    // fetch and deliver new points of all series, false if a query failed
+    bool poll();
+
+    // poll every intervalMs on a background thread until stop()
+    void start();
+    void stop();
+
+   private:
+    struct Series {
+        std::string measurement;
+        TSDataType type;
+        int64_t lastSeen;
+    };
+    typedef std::map<std::string, std::vector<Series> > DeviceMap;
+
+    SeriesFollower(const SeriesFollower &);
+    SeriesFollower &operator=(const SeriesFollower &);
+
+    static void *runPolling(void *arg);
+    bool pollGroup(DeviceMap::iterator first, DeviceMap::iterator last);
+    // store the last seen timestamps of `polled` in devices_, except for
+    // series followed again or unfollowed since `before` was copied
+    void storeLastSeen(const DeviceMap &before, const DeviceMap &polled);
+    void deliver(const std::string &device, std::vector<Series> &series,
+                 const Json::Value &response,
+                 const std::map<std::string, size_t> &columns);
+
+    RestClient *client_;
+    FollowerListener *listener_;
+    FollowerOptions options_;
+    Mutex mutex_;  // guards devices_
+    DeviceMap devices_;
+    Mutex pollMutex_;  // held during a poll, guards points_
+    Tablet points_;    // reused for every delivery
+
+    pthread_t thread_;
+    bool running_;
+    Mutex stopMutex_;
+    Condition stopCondition_;
+    bool stopping_;
+};
+
+/** ------ end series follower ------ */
+
+}  // namespace rest_client
+#endif  // SERIES_FOLLOWER_H
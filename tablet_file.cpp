@@ -0,0 +1,483 @@
+#include "tablet_file.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "concurrency.h"
+
+namespace rest_client {
+
+/** ------ tablet file format defination ------ */
+static const size_t BLOCK_HEADER_BYTES = 24;
+
+static size_t pad8(size_t length) { return (length + 7) & ~(size_t)7; }
+
+static uint32_t readU32(const char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+bool TabletFileWriter::open(const std::string& path) {
+    close();
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        std::cout << "open tablet file failed: " << path << std::endl;
+        return false;
+    }
+    offset_ = 0;
+    uint32_t header[2] = {TABLET_FILE_VERSION, 0};
+    return writeBytes(TABLET_FILE_MAGIC, sizeof(TABLET_FILE_MAGIC)) &&
+           writeBytes(header, sizeof(header));
+}
+
+bool TabletFileWriter::writeBytes(const void* data, size_t length) {
+    if (length != 0 && fwrite(data, 1, length, file_) != length) {
+        std::cout << "write tablet file failed" << std::endl;
+        return false;
+    }
+    offset_ += length;
+    return true;
+}
+
+bool TabletFileWriter::writePadding() {
+    static const char zeros[8] = {0};
+    return writeBytes(zeros, pad8(offset_) - offset_);
+}
+
+bool TabletFileWriter::write(const Tablet& tablet) {
+    if (!file_) {
+        return false;
+    }
+    if (tablet.rowSize == 0) {
+        return true;
+    }
+    size_t rows = tablet.rowSize;
+    size_t bitmapBytes = (rows >> 3) + 1;
+    uint64_t blockBytes = BLOCK_HEADER_BYTES + tablet.deviceId.size();
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        blockBytes += 8 + tablet.schemas[i].first.size();
+    }
+    blockBytes = pad8(blockBytes) + rows * sizeof(int64_t);
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        blockBytes += pad8(bitmapBytes);
+        TSDataType type = tablet.schemas[i].second;
+        if (type == TEXT) {
+            uint64_t textBytes = 0;
+            for (size_t row = 0; row < rows; row++) {
+                textBytes += tablet.getText(i, row).length;
+            }
+            // the offsets are u32, so check before any byte of the block
+            // is written rather than leave a block the reader mis-slices
+            if (textBytes > 0xffffffffu) {
+                std::cout << "tablet file can not hold " << textBytes
+                          << " bytes of text in column "
+                          << tablet.schemas[i].first << std::endl;
+                return false;
+            }
+            blockBytes += pad8((rows + 1) * 4) + pad8(textBytes);
+        } else if (DatatypeFixedWidth(type) != 0) {
+            blockBytes += pad8(rows * DatatypeFixedWidth(type));
+        } else {
+            std::cout << "tablet file does not support data type "
+                      << DatatypeToString(type) << std::endl;
+            return false;
+        }
+    }
+
+    uint32_t header[4] = {(uint32_t)rows, (uint32_t)tablet.schemas.size(),
+                          (uint32_t)tablet.deviceId.size(),
+                          tablet.isAligned ? 1u : 0u};
+    if (!writeBytes(&blockBytes, sizeof(blockBytes)) ||
+        !writeBytes(header, sizeof(header)) ||
+        !writeBytes(tablet.deviceId.data(), tablet.deviceId.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        const std::string& name = tablet.schemas[i].first;
+        uint32_t schema[2] = {(uint32_t)tablet.schemas[i].second,
+                              (uint32_t)name.size()};
+        if (!writeBytes(schema, sizeof(schema)) ||
+            !writeBytes(name.data(), name.size())) {
+            return false;
+        }
+    }
+    if (!writePadding()) {
+        return false;
+    }
+    if (tablet.isTimestampCompressed()) {
+        std::vector<int64_t> timestamps(rows);
+        for (size_t row = 0; row < rows; row++) {
+            timestamps[row] = tablet.getTimestamp(row);
+        }
+        if (rows != 0 &&
+            !writeBytes(&timestamps[0], rows * sizeof(int64_t))) {
+            return false;
+        }
+    } else if (!writeBytes(&tablet.timestamps[0], rows * sizeof(int64_t))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < tablet.schemas.size(); i++) {
+        if (!writeBytes(&tablet.bitMaps[i].getByteArray()[0], bitmapBytes) ||
+            !writePadding()) {
+            return false;
+        }
+        TSDataType type = tablet.schemas[i].second;
+        if (type != TEXT) {
+            if (!writeBytes(tablet.values[i], rows * DatatypeFixedWidth(type)) ||
+                !writePadding()) {
+                return false;
+            }
+            continue;
+        }
+        std::vector<uint32_t> offsets(rows + 1);
+        offsets[0] = 0;
+        for (size_t row = 0; row < rows; row++) {
+            offsets[row + 1] = offsets[row] + tablet.getText(i, row).length;
+        }
+        if (!writeBytes(&offsets[0], offsets.size() * 4) || !writePadding()) {
+            return false;
+        }
+        for (size_t row = 0; row < rows; row++) {
+            const TextRef& text = tablet.getText(i, row);
+            if (!writeBytes(text.data, text.length)) {
+                return false;
+            }
+        }
+        if (!writePadding()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TabletFileWriter::close() {
+    if (!file_) {
+        return true;
+    }
+    bool ok = fclose(file_) == 0;
+    file_ = NULL;
+    return ok;
+}
+
+bool TabletFileReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "open tablet file failed: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16) {
+        std::cout << "invalid tablet file: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "mmap tablet file failed: " << path << std::endl;
+        return false;
+    }
+    data_ = (const char*)data;
+    length_ = st.st_size;
+    madvise(data, length_, MADV_SEQUENTIAL);
+
+    if (memcmp(data_, TABLET_FILE_MAGIC, sizeof(TABLET_FILE_MAGIC)) != 0 ||
+        readU32(data_ + 8) != TABLET_FILE_VERSION) {
+        std::cout << "invalid tablet file header: " << path << std::endl;
+        close();
+        return false;
+    }
+    size_t offset = 16;
+    while (offset + BLOCK_HEADER_BYTES <= length_) {
+        uint64_t blockBytes;
+        memcpy(&blockBytes, data_ + offset, sizeof(blockBytes));
+        if (blockBytes < BLOCK_HEADER_BYTES || blockBytes % 8 != 0 ||
+            blockBytes > length_ - offset) {
+            std::cout << "truncated tablet file: " << path << std::endl;
+            close();
+            return false;
+        }
+        blocks_.push_back(std::make_pair(offset, (size_t)blockBytes));
+        offset += blockBytes;
+    }
+    return true;
+}
+
+void TabletFileReader::close() {
+    if (data_) {
+        munmap((void*)data_, length_);
+    }
+    data_ = NULL;
+    length_ = 0;
+    blocks_.clear();
+}
+
+// advance `p` over `length` bytes, false if they are not inside the block
+static bool skipBytes(const char*& p, const char* end, size_t length) {
+    if (length > (size_t)(end - p)) {
+        return false;
+    }
+    p += length;
+    return true;
+}
+
+bool TabletFileReader::getTablet(size_t index, TabletView& view) const {
+    if (index >= blocks_.size()) {
+        return false;
+    }
+    const char* block = data_ + blocks_[index].first;
+    const char* end = block + blocks_[index].second;
+    size_t rows = readU32(block + 8);
+    size_t columnCount = readU32(block + 12);
+    size_t deviceLength = readU32(block + 16);
+    const char* p = block + BLOCK_HEADER_BYTES;
+
+    // every length comes from the file, check it before it is followed
+    const char* device = p;
+    // every schema takes at least 8 bytes, which bounds columnCount
+    if (!skipBytes(p, end, deviceLength) ||
+        columnCount > (size_t)(end - p) / 8) {
+        std::cout << "corrupted tablet block " << index << std::endl;
+        return false;
+    }
+    view.rowSize = rows;
+    view.isAligned = readU32(block + 20) != 0;
+    view.deviceId.assign(device, deviceLength);
+    view.columns.resize(columnCount);
+    for (size_t i = 0; i < columnCount; i++) {
+        const char* schema = p;
+        if (!skipBytes(p, end, 8) ||
+            !skipBytes(p, end, readU32(schema + 4))) {
+            std::cout << "corrupted tablet block " << index << std::endl;
+            return false;
+        }
+        TabletView::Column& column = view.columns[i];
+        column.type = (TSDataType)readU32(schema);
+        column.name.assign(schema + 8, readU32(schema + 4));
+        if (column.type != TEXT && DatatypeFixedWidth(column.type) == 0) {
+            std::cout << "corrupted tablet block " << index
+                      << ": unknown data type" << std::endl;
+            return false;
+        }
+    }
+    if (!skipBytes(p, end, pad8(p - block) - (p - block))) {
+        std::cout << "corrupted tablet block " << index << std::endl;
+        return false;
+    }
+    view.timestamps = (const int64_t*)p;
+    if (!skipBytes(p, end, rows * sizeof(int64_t))) {
+        std::cout << "corrupted tablet block " << index << std::endl;
+        return false;
+    }
+
+    size_t bitmapBytes = pad8((rows >> 3) + 1);
+    for (size_t i = 0; i < columnCount; i++) {
+        TabletView::Column& column = view.columns[i];
+        column.bitmap = (const unsigned char*)p;
+        column.values = NULL;
+        column.textOffsets = NULL;
+        column.text = NULL;
+        bool ok = skipBytes(p, end, bitmapBytes);
+        if (ok && column.type == TEXT) {
+            column.textOffsets = (const uint32_t*)p;
+            ok = skipBytes(p, end, pad8((rows + 1) * 4));
+            for (size_t row = 0; ok && row < rows; row++) {
+                ok = column.textOffsets[row] <= column.textOffsets[row + 1];
+            }
+            column.text = p;
+            ok = ok && column.textOffsets[0] == 0 &&
+                 skipBytes(p, end, pad8(column.textOffsets[rows]));
+        } else if (ok) {
+            column.values = p;
+            ok = skipBytes(p, end,
+                           pad8(rows * DatatypeFixedWidth(column.type)));
+        }
+        if (!ok) {
+            std::cout << "corrupted tablet block " << index << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void TabletFileReader::release(size_t index) const {
+    if (index >= blocks_.size()) {
+        return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = blocks_[index].first & ~(page - 1);
+    size_t end = blocks_[index].first + blocks_[index].second;
+    madvise((void*)(data_ + begin), end - begin, MADV_DONTNEED);
+}
+
+void TabletView::serializeJson(std::string& out) const {
+    out += "{\"device\":";
+    appendJsonString(out, deviceId.data(), deviceId.size());
+    out += isAligned ? ",\"is_aligned\":true" : ",\"is_aligned\":false";
+    out += ",\"timestamps\":[";
+    for (size_t row = 0; row < rowSize; row++) {
+        if (row != 0) out += ',';
+        appendJsonInt64(out, timestamps[row]);
+    }
+    out += "],\"measurements\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (i != 0) out += ',';
+        appendJsonString(out, columns[i].name.data(), columns[i].name.size());
+    }
+    out += "],\"data_types\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        std::string type = DatatypeToString(columns[i].type);
+        if (i != 0) out += ',';
+        appendJsonString(out, type.data(), type.size());
+    }
+    out += "],\"values\":[";
+    for (size_t i = 0; i < columns.size(); i++) {
+        out += i == 0 ? "[" : ",[";
+        for (size_t row = 0; row < rowSize; row++) {
+            if (row != 0) out += ',';
+            if (!isMarked(i, row)) {
+                out += "null";
+                continue;
+            }
+            switch (columns[i].type) {
+                case BOOLEAN:
+                    out += getValue<bool>(i, row) ? "true" : "false";
+                    break;
+                case INT32:
+                    appendJsonInt64(out, getValue<int>(i, row));
+                    break;
+                case INT64:
+                    appendJsonInt64(out, getValue<int64_t>(i, row));
+                    break;
+                case FLOAT:
+                    appendJsonFloat(out, getValue<float>(i, row));
+                    break;
+                case DOUBLE:
+                    appendJsonDouble(out, getValue<double>(i, row));
+                    break;
+                case TEXT: {
+                    size_t length;
+                    const char* text = getText(i, row, length);
+                    appendJsonString(out, text, length);
+                    break;
+                }
+                default:
+                    out += "null";
+            }
+        }
+        out += ']';
+    }
+    out += "]}";
+}
+
+void TabletView::copyTo(Tablet& tablet) const {
+    std::vector<std::pair<std::string, TSDataType> > schemas;
+    for (size_t i = 0; i < columns.size(); i++) {
+        schemas.push_back(std::make_pair(columns[i].name, columns[i].type));
+    }
+    tablet.init(deviceId, schemas, rowSize);
+    tablet.setAligned(isAligned);
+    if (rowSize == 0) {
+        return;
+    }
+    tablet.appendTimestamps(timestamps, rowSize);
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].type != TEXT) {
+            memcpy(tablet.values[i], columns[i].values,
+                   rowSize * DatatypeFixedWidth(columns[i].type));
+        }
+        for (size_t row = 0; row < rowSize; row++) {
+            if (!isMarked(i, row)) {
+                continue;
+            }
+            if (columns[i].type == TEXT) {
+                size_t length;
+                const char* text = getText(i, row, length);
+                tablet.addText(i, row, text, length);
+            }
+            tablet.bitMaps[i].mark(row);
+        }
+    }
+}
+
+struct TabletLoadSender {
+    RestClient* client;
+    BlockingQueue<std::string*>* queue;
+    size_t failed;
+};
+
+static void* sendTabletPayloads(void* arg) {
+    TabletLoadSender* sender = (TabletLoadSender*)arg;
+    std::string* payload;
+    while (sender->queue->pop(payload)) {
+        if (!sender->client->insertTabletPayload(*payload)) {
+            sender->failed++;
+        }
+        delete payload;
+    }
+    return NULL;
+}
+
+bool loadTabletFile(const TabletFileReader& reader,
+                    const std::vector<RestClient*>& clients,
+                    size_t queueDepth, size_t* failed) {
+    if (clients.empty()) {
+        std::cout << "loadTabletFile() needs at least one client" << std::endl;
+        return false;
+    }
+    BlockingQueue<std::string*> queue(queueDepth);
+    std::vector<TabletLoadSender> senders(clients.size());
+    std::vector<pthread_t> threads(clients.size());
+    size_t started = 0;
+    for (size_t i = 0; i < clients.size(); i++) {
+        senders[i].client = clients[i];
+        senders[i].queue = &queue;
+        senders[i].failed = 0;
+        if (pthread_create(&threads[i], NULL, sendTabletPayloads,
+                           &senders[i]) != 0) {
+            std::cout << "loadTabletFile() could not start sender " << i
+                      << std::endl;
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        if (failed) {
+            *failed = reader.tabletCount();
+        }
+        return false;
+    }
+
+    size_t failures = 0;
+    TabletView view;
+    for (size_t i = 0; i < reader.tabletCount(); i++) {
+        if (!reader.getTablet(i, view)) {
+            failures++;
+            continue;
+        }
+        std::string* payload = new std::string();
+        view.serializeJson(*payload);
+        reader.release(i);
+        queue.push(payload);
+    }
+    queue.close();
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        failures += senders[i].failed;
+    }
+    if (failed) {
+        *failed = failures;
+    }
+    return failures == 0;
+}
+
+/** ------ end tablet file format defination ------ */
+
+}  // namespace rest_client
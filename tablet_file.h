@@ -0,0 +1,137 @@
+#ifndef TABLET_FILE_H
+#define TABLET_FILE_H
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ tablet file format ------ */
+/**
+ * Binary dump of Tablets, laid out so that a mapped file can be read in
+ * place. All integers are host endian and every section starts on an 8 byte
+ * boundary.
+ *
+ *   file    := "IOTDBTF1" version:u32 reserved:u32 block*
+ *   block   := blockBytes:u64 rowSize:u32 columnCount:u32
+ *              deviceLength:u32 isAligned:u32 device
+ *              (type:u32 nameLength:u32 name)*            padding
+ *              timestamps:i64[rowSize]
+ *              (bitmap:u8[rowSize / 8 + 1] padding column)*
+ *   column  := values[rowSize] padding                   fixed width types
+ *            | offsets:u32[rowSize + 1] padding bytes padding       TEXT
+ *
+ * `blockBytes` counts the whole block including its own header, so a reader
+ * can skip from block to block without looking at the columns. A TEXT column
+ * holds at most 4 GiB of text; write() rejects larger ones.
+ */
+static const char TABLET_FILE_MAGIC[8] = {'I', 'O', 'T', 'D',
+                                          'B', 'T', 'F', '1'};
+static const uint32_t TABLET_FILE_VERSION = 1;
+
+class TabletFileWriter {
+   public:
+    TabletFileWriter() : file_(NULL) {}
+    ~TabletFileWriter() { close(); }
+
+    bool open(const std::string &path);
+    // append the first `tablet.rowSize` rows of `tablet` as one block
+    bool write(const Tablet &tablet);
+    bool close();
+
+   private:
+    TabletFileWriter(const TabletFileWriter &);
+    TabletFileWriter &operator=(const TabletFileWriter &);
+
+    bool writeBytes(const void *data, size_t length);
+    bool writePadding();
+
+    FILE *file_;
+    uint64_t offset_;
+};
+
+// One block of a mapped tablet file. All pointers refer into the mapping and
+// stay valid as long as the TabletFileReader that returned the view is open.
+class TabletView {
+   public:
+    struct Column {
+        std::string name;
+        TSDataType type;
+        const unsigned char *bitmap;
+        const void *values;          // fixed width types
+        const uint32_t *textOffsets;  // TEXT: rowSize + 1 offsets into text
+        const char *text;
+    };
+
+    std::string deviceId;
+    bool isAligned;
+    size_t rowSize;
+    const int64_t *timestamps;
+    std::vector<Column> columns;
+
+    bool isMarked(size_t column, size_t row) const {
+        return (columns[column].bitmap[row >> 3] & (1 << (row % 8))) != 0;
+    }
+
+    template <typename T>
+    T getValue(size_t column, size_t row) const {
+        return ((const T *)columns[column].values)[row];
+    }
+
+    const char *getText(size_t column, size_t row, size_t &length) const {
+        const Column &c = columns[column];
+        length = c.textOffsets[row + 1] - c.textOffsets[row];
+        return c.text + c.textOffsets[row];
+    }
+
+    // insertTablet request body, equivalent to Tablet::toJson()
+    void serializeJson(std::string &out) const;
+
+    // rebuild `tablet` with a copy of this block
+    void copyTo(Tablet &tablet) const;
+};
+
+class TabletFileReader {
+   public:
+    TabletFileReader() : data_(NULL), length_(0) {}
+    ~TabletFileReader() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+
+    size_t tabletCount() const { return blocks_.size(); }
+    // decode the block header of tablet `index`, the columns are not copied;
+    // false if a length in the block points past its end
+    bool getTablet(size_t index, TabletView &view) const;
+    // tell the kernel the pages of tablet `index` will not be needed again
+    void release(size_t index) const;
+
+   private:
+    TabletFileReader(const TabletFileReader &);
+    TabletFileReader &operator=(const TabletFileReader &);
+
+    const char *data_;
+    size_t length_;
+    std::vector<std::pair<size_t, size_t> > blocks_;  // offset and length
+};
+
+/**
+ * Send every tablet of `reader` through insertTablet. The calling thread
+ * renders request bodies ahead of the senders, at most `queueDepth` at a
+ * time, while one sender thread per client keeps a request in flight on each
+ * connection. Mapped pages are released once their tablet was serialized.
+ *
+ * Return false if any tablet could not be inserted; `failed` counts them.
+ */
+bool loadTabletFile(const TabletFileReader &reader,
+                    const std::vector<RestClient *> &clients,
+                    size_t queueDepth, size_t *failed = NULL);
+
+/** ------ end tablet file format ------ */
+
+}  // namespace rest_client
+#endif  // TABLET_FILE_H
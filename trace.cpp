@@ -0,0 +1,151 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "concurrency.h"
+
+namespace rest_client {
+
+/** ------ span tracing defination ------ */
+struct TraceEvent {
+    const char* name;
+    const char* labelKey;
+    uint64_t startMicros;
+    uint64_t durationMicros;
+    int64_t rows;
+    int64_t bytes;
+    char label[48];  // truncated copy, recording must not allocate
+};
+
+struct TraceBuffer {
+    size_t thread;  // tid in the exported trace
+    std::vector<TraceEvent> events;
+    uint64_t head;     // spans recorded so far, written by the owner only
+    uint64_t cleared;  // spans before this one were dropped by clear()
+};
+
+bool Tracer::enabled_ = false;
+
+static Mutex traceMutex;  // guards traceBuffers and traceCapacity
+static std::vector<TraceBuffer*> traceBuffers;
+static size_t traceCapacity = 65536;
+static __thread TraceBuffer* threadTraceBuffer = NULL;
+
+void Tracer::enable(size_t spansPerThread) {
+    {
+        MutexLock lock(traceMutex);
+        // threads that already recorded keep the size of their buffer
+        traceCapacity = spansPerThread == 0 ? 1 : spansPerThread;
+    }
+    __atomic_store_n(&enabled_, true, __ATOMIC_RELEASE);
+}
+
+void Tracer::disable() { __atomic_store_n(&enabled_, false, __ATOMIC_RELEASE); }
+
+void Tracer::record(const char* name, uint64_t startMicros,
+                    uint64_t durationMicros, const char* labelKey,
+                    const std::string& label, int64_t rows, int64_t bytes) {
+    TraceBuffer* buffer = threadTraceBuffer;
+    if (!buffer) {
+        MutexLock lock(traceMutex);
+        buffer = new TraceBuffer();
+        buffer->thread = traceBuffers.size() + 1;
+        buffer->events.resize(traceCapacity);
+        buffer->head = 0;
+        buffer->cleared = 0;
+        traceBuffers.push_back(buffer);
+        threadTraceBuffer = buffer;
+    }
+    uint64_t head = buffer->head;
+    TraceEvent& event = buffer->events[head % buffer->events.size()];
+    event.name = name;
+    event.labelKey = labelKey;
+    event.startMicros = startMicros;
+    event.durationMicros = durationMicros;
+    event.rows = rows;
+    event.bytes = bytes;
+    size_t length = label.size() < sizeof(event.label) - 1
+                        ? label.size()
+                        : sizeof(event.label) - 1;
+    memcpy(event.label, label.data(), length);
+    event.label[length] = '\0';
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void Tracer::exportChromeTrace(std::string& out) {
+    MutexLock lock(traceMutex);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (size_t i = 0; i < traceBuffers.size(); i++) {
+        TraceBuffer& buffer = *traceBuffers[i];
+        uint64_t head = __atomic_load_n(&buffer.head, __ATOMIC_ACQUIRE);
+        uint64_t begin = __atomic_load_n(&buffer.cleared, __ATOMIC_RELAXED);
+        if (head - begin > buffer.events.size()) {
+            begin = head - buffer.events.size();
+        }
+        for (uint64_t n = begin; n < head; n++) {
+            const TraceEvent& event = buffer.events[n % buffer.events.size()];
+            out += first ? "{\"name\":" : ",{\"name\":";
+            first = false;
+            appendJsonString(out, event.name, strlen(event.name));
+            out += ",\"cat\":\"rest_client\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            appendJsonInt64(out, buffer.thread);
+            out += ",\"ts\":";
+            appendJsonInt64(out, event.startMicros);
+            out += ",\"dur\":";
+            appendJsonInt64(out, event.durationMicros);
+            out += ",\"args\":{";
+            bool firstArg = true;
+            if (event.labelKey) {
+                appendJsonString(out, event.labelKey, strlen(event.labelKey));
+                out += ':';
+                appendJsonString(out, event.label, strlen(event.label));
+                firstArg = false;
+            }
+            if (event.rows >= 0) {
+                out += firstArg ? "\"rows\":" : ",\"rows\":";
+                appendJsonInt64(out, event.rows);
+                firstArg = false;
+            }
+            if (event.bytes >= 0) {
+                out += firstArg ? "\"bytes\":" : ",\"bytes\":";
+                appendJsonInt64(out, event.bytes);
+            }
+            out += "}}";
+        }
+    }
+    out += "]}";
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) {
+    std::string out;
+    exportChromeTrace(out);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "open trace file failed: " << path << std::endl;
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cout << "write trace file failed: " << path << std::endl;
+    }
+    return ok;
+}
+
+void Tracer::clear() {
+    MutexLock lock(traceMutex);
+    for (size_t i = 0; i < traceBuffers.size(); i++) {
+        TraceBuffer& buffer = *traceBuffers[i];
+        __atomic_store_n(&buffer.cleared,
+                         __atomic_load_n(&buffer.head, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELAXED);
+    }
+}
+
+/** ------ end span tracing defination ------ */
+
+}  // namespace rest_client
@@ -0,0 +1,98 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+#include "rest_client.h"
+
+namespace rest_client {
+
+/** ------ span tracing ------ */
+/**
+ * Optional span tracing of client operations, exported in the Chrome trace
+ * event format that chrome://tracing and Perfetto open.
+ *
+ * Every thread records finished spans into its own ring buffer, which only
+ * that thread writes, so recording takes no lock; a full buffer overwrites
+ * its oldest spans. Export after the traced work finished: spans that are
+ * overwritten while exportChromeTrace() copies them may come out torn.
+ * While tracing is disabled a TraceSpan costs one atomic load.
+ */
+class Tracer {
+   public:
+    // start recording, every thread keeps its last `spansPerThread` spans
+    static void enable(size_t spansPerThread = 65536);
+    static void disable();
+    static bool isEnabled() {
+        return __atomic_load_n(&enabled_, __ATOMIC_RELAXED);
+    }
+
+    // record a finished span of the calling thread, see TraceSpan for tags;
+    // `name` and `labelKey` must be string literals
+    static void record(const char *name, uint64_t startMicros,
+                       uint64_t durationMicros, const char *labelKey,
+                       const std::string &label, int64_t rows, int64_t bytes);
+
+    // append {"traceEvents":[...]} with the spans of all threads
+    static void exportChromeTrace(std::string &out);
+    static bool writeChromeTrace(const std::string &path);
+    // drop the recorded spans, buffers stay allocated
+    static void clear();
+
+   private:
+    static bool enabled_;
+};
+
+/**
+ * Record the lifetime of the span as a complete event named `name`, which
+ * must be a string literal. Tags are optional and show up as args.
+ */
+class TraceSpan {
+   public:
+    explicit TraceSpan(const char *name)
+        : name_(name),
+          active_(Tracer::isEnabled()),
+          labelKey_(NULL),
+          rows_(-1),
+          bytes_(-1) {
+        if (active_) startMicros_ = monotonicMicros();
+    }
+    ~TraceSpan() {
+        if (active_) {
+            Tracer::record(name_, startMicros_,
+                           monotonicMicros() - startMicros_, labelKey_,
+                           label_, rows_, bytes_);
+        }
+    }
+
+    bool isActive() const { return active_; }
+    uint64_t startMicros() const { return startMicros_; }
+
+    void setDevice(const std::string &device) { setLabel("device", device); }
+    // `key` must be a string literal
+    void setLabel(const char *key, const std::string &value) {
+        if (active_) {
+            labelKey_ = key;
+            label_ = value;
+        }
+    }
+    void setRows(int64_t rows) { rows_ = rows; }
+    void setBytes(int64_t bytes) { bytes_ = bytes; }
+
+   private:
+    TraceSpan(const TraceSpan &);
+    TraceSpan &operator=(const TraceSpan &);
+
+    const char *name_;
+    bool active_;
+    uint64_t startMicros_;
+    const char *labelKey_;
+    std::string label_;
+    int64_t rows_;
+    int64_t bytes_;
+};
+
+/** ------ end span tracing ------ */
+
+}  // namespace rest_client
+#endif  // TRACE_H